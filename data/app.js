@@ -15,6 +15,8 @@ for (let i = 1; i <= 4; i++) {
     <div class="kv"><span>Voltage:</span><span id="v${i}">0 V</span></div>
     <div class="kv"><span>Current:</span><span id="c${i}">0 A</span></div>
     <div class="kv"><span>Power:</span><span id="p${i}">0 W</span></div>
+    <div class="kv"><span>Peak:</span><span id="pk${i}">0 W</span></div>
+    <div class="kv"><span>Demand:</span><span id="d${i}">0 W</span></div>
     <div class="kv"><span>Energy:</span><span id="e${i}">0 Wh</span></div>
     <div class="kv"><span>State:</span><span id="s${i}">OFF</span></div>
   `;
@@ -47,10 +49,8 @@ document.getElementById("saveLimits").addEventListener("click", ()=>{
     parseFloat(document.getElementById("limit3").value||"12"),
     parseFloat(document.getElementById("limit4").value||"12"),
   ];
-  vals.forEach((h,i)=>{
-    const sec = Math.max(1, Math.round(h*3600));
-    ws.send(JSON.stringify({cmd:"setLimit", id:i+1, seconds:sec}));
-  });
+  const seconds = vals.map(h=> Math.max(1, Math.round(h*3600)));
+  ws.send(JSON.stringify({cmd:"setLimits", seconds}));
 });
 
 // Price
@@ -61,7 +61,7 @@ document.getElementById("savePrice").addEventListener("click", ()=>{
 
 // Notifications
 document.getElementById("refreshNotifs").addEventListener("click", async ()=>{
-  const r = await fetch("/notifs.json");
+  const r = await fetch("/api/notifs?limit=50");
   const j = await r.json();
   showNotifs(j.notifs || []);
 });
@@ -72,46 +72,162 @@ document.getElementById("clearNotifs").addEventListener("click", ()=>{
 
 // Charts / PDF util
 const chartCtx = document.getElementById("chart").getContext("2d");
-const chart = new Chart(chartCtx, {
-  type: "line",
-  data: { labels: [], datasets: [
-    { label: "Load1", data: [] },
-    { label: "Load2", data: [] },
-    { label: "Load3", data: [] },
-    { label: "Load4", data: [] }
-  ]},
-  options: { responsive:true, plugins:{legend:{display:true}} }
+let chart = null;
+let histData = null;
+function drawChart(type, labels, series){
+  if(chart) chart.destroy();
+  chart = new Chart(chartCtx, {
+    type: type,
+    data: { labels: labels, datasets: series.map((d,k)=>({ label: "Load"+(k+1)+" (Wh)", data: d })) },
+    options: { responsive:true, plugins:{legend:{display:true}} }
+  });
+}
+drawChart("line", [], [[],[],[],[]]);
+
+// Day-granular range from the From/To pickers, in epoch seconds (local time).
+function pickedRange(){
+  const f = document.getElementById("fromDate").value;
+  const t = document.getElementById("toDate").value;
+  const today = new Date(); today.setHours(0,0,0,0);
+  const from = f ? new Date(f+"T00:00:00") : today;
+  const to = t ? new Date(t+"T00:00:00") : new Date(from);
+  to.setDate(to.getDate()+1);
+  return { from: Math.floor(from/1000), to: Math.floor(to/1000) };
+}
+
+// Days of the daily ledger in [from, to), the running day included. Their
+// cost was counted at the price in effect at the time.
+async function fetchDays(from, to){
+  const r = await fetch(`/api/days?from=${from}&to=${to}`);
+  if(!r.ok) throw new Error("days " + r.status);
+  const j = await r.json();
+  return j.days.concat(j.today ? [j.today] : []).filter(d=> d.t>=from && d.t<to);
+}
+
+async function fetchHistory(){
+  const { from, to } = pickedRange();
+  const step = (to-from) <= 2*86400 ? 3600 : 86400;
+  const r = await fetch(`/api/history?from=${from}&to=${to}&step=${step}`);
+  if(!r.ok) throw new Error("history " + r.status);
+  const h = await r.json();
+  h.days = await fetchDays(from, to);
+  return h;
+}
+
+function renderHistory(){
+  if(!histData) return;
+  const labels = histData.points.map(p=>{
+    const d = new Date(p.t*1000);
+    return histData.step < 86400 ? d.toLocaleString([], {month:"short", day:"numeric", hour:"2-digit"}) : d.toLocaleDateString();
+  });
+  const series = histData.loads.map((_,k)=> histData.points.map(p=> p.wh[k]));
+  drawChart(document.getElementById("chartType").value, labels, series);
+  const totals = histData.loads.map((id,k)=>{
+    const wh = histData.points.reduce((s,p)=> s + p.wh[k], 0);
+    const on = histData.points.reduce((s,p)=> s + p.on[k], 0);
+    const cost = histData.days.reduce((s,d)=> s + d.cost[id-1], 0);
+    return { id, kwh: wh/1000, hours: on/3600, cost };
+  });
+  histData.totals = totals;
+  document.getElementById("report").innerHTML = totals.map(t=>
+    `Load ${t.id}: ${t.kwh.toFixed(3)} kWh · ${t.hours.toFixed(1)} h on · ${t.cost.toFixed(2)}`).join("<br>");
+}
+
+document.getElementById("loadCharts").addEventListener("click", async ()=>{
+  try { histData = await fetchHistory(); renderHistory(); }
+  catch(e){ console.error("History load failed", e); }
 });
+document.getElementById("chartType").addEventListener("change", renderHistory);
+
 document.getElementById("downloadPdf").addEventListener("click", async ()=>{
-  const r = await fetch("/logs.json");
-  const j = await r.json();
+  if(!histData) { histData = await fetchHistory(); renderHistory(); }
   const { jsPDF } = window.jspdf;
   const doc = new jsPDF();
-  doc.text("ESP32 Power Tracker - Logs snapshot", 10, 10);
-  doc.text(JSON.stringify(j).slice(0, 1500), 10, 20);
-  doc.save("logs.pdf");
+  const range = new Date(histData.from*1000).toLocaleDateString() + " - " + new Date((histData.to-1)*1000).toLocaleDateString();
+  doc.text("ESP32 Power Tracker - Report " + range, 10, 10);
+  let y = 20;
+  histData.totals.forEach(t=>{
+    doc.text(`Load ${t.id}: ${t.kwh.toFixed(3)} kWh, ${t.hours.toFixed(1)} h on, cost ${t.cost.toFixed(2)}`, 10, y);
+    y += 8;
+  });
+  doc.addImage(chart.toBase64Image("image/jpeg", 0.92), "JPEG", 10, y, 190, 95);
+  doc.save("report.pdf");
 });
 
+// Binary state frame (see include/telemetry.h for the layout)
+const FRAME_VERSION = 2, FRAME_HEADER_LEN = 16, FRAME_LOAD_LEN = 80;
+function decodeStateFrame(buf){
+  const dv = new DataView(buf);
+  if(dv.getUint8(0) !== 0x50 || dv.getUint8(1) !== 0x54 || dv.getUint8(2) !== FRAME_VERSION) return null;
+  const n = dv.getUint8(3);
+  const u64 = o => dv.getUint32(o+4, true) * 4294967296 + dv.getUint32(o, true);
+  const data = { type: "state", seq: dv.getUint32(4, true), unitPrice: dv.getUint32(8, true)/1000,
+                 sampleHz: dv.getUint16(12, true), loads: [] };
+  for(let k=0;k<n;k++){
+    const o = FRAME_HEADER_LEN + k*FRAME_LOAD_LEN;
+    const flags = dv.getUint8(o+1);
+    const L = {
+      id: dv.getUint8(o), relay: !!(flags & 1), n: dv.getUint16(o+2, true),
+      voltage: dv.getUint16(o+4, true)/1e3, vMin: dv.getUint16(o+6, true)/1e3, vMax: dv.getUint16(o+8, true)/1e3,
+      current: dv.getUint32(o+12, true)/1e6, iMin: dv.getUint32(o+16, true)/1e6,
+      iMax: dv.getUint32(o+20, true)/1e6, iRms: dv.getUint32(o+24, true)/1e6,
+      power: dv.getUint32(o+28, true)/1e3, pMin: dv.getUint32(o+32, true)/1e3, pMax: dv.getUint32(o+36, true)/1e3,
+      energy: u64(o+40)/1e6, cost: u64(o+48)/1e3,
+      onSecToday: dv.getUint32(o+56, true), limitSec: dv.getUint32(o+60, true),
+      timerMin: dv.getUint16(o+68, true),
+      demand: dv.getUint32(o+72, true)/1e3, peakToday: dv.getUint32(o+76, true)/1e3
+    };
+    if(flags & 2) L.timerEnd = dv.getUint32(o+64, true);
+    data.loads.push(L);
+  }
+  return data;
+}
+
+// Last known state per load; delta updates only carry what changed.
+const loadState = {};
+function renderState(data){
+  data.loads.forEach((upd)=>{
+    const i = upd.id;
+    const L = Object.assign(loadState[i] || (loadState[i] = {}), upd);
+    document.getElementById("v"+i).innerText = Number(L.voltage||0).toFixed(2)+" V";
+    document.getElementById("c"+i).innerText = Number(L.current||0).toFixed(3)+" A";
+    document.getElementById("p"+i).innerText = Number(L.power||0).toFixed(2)+" W";
+    document.getElementById("pk"+i).innerText = Number(L.pMax||0).toFixed(2)+" W";
+    document.getElementById("d"+i).innerText = Number(L.demand||0).toFixed(2)+" W";
+    document.getElementById("e"+i).innerText = Number(L.energy||0).toFixed(2)+" Wh";
+    document.getElementById("s"+i).innerText = L.relay ? "ON" : "OFF";
+    document.getElementById("relay"+i).checked = !!L.relay;
+  });
+  // Binary frames carry no panel object; the loads' demands sum to the panel's.
+  const P = data.panel || { demand: Object.values(loadState).reduce((a,L)=>a+(L.demand||0), 0) };
+  let txt = Number(P.demand).toFixed(1)+" W";
+  if(P.peakToday !== undefined) txt += " · peak today "+Number(P.peakToday).toFixed(1)+" W";
+  if(P.limit) txt += " · limit "+P.limit+" W";
+  document.getElementById("panelDemand").innerText = txt;
+  if(data.unitPrice) document.getElementById("price").value = data.unitPrice;
+}
+
 // WebSocket incoming messages
-ws.onopen = ()=> { console.log("WS open"); }
+ws.binaryType = "arraybuffer";
+ws.onopen = ()=> {
+  console.log("WS open");
+  ws.send(JSON.stringify({cmd:"binary", on:true}));
+  ws.send(JSON.stringify({cmd:"delta", on:true}));
+}
 ws.onclose = ()=> { console.log("WS closed"); }
 ws.onerror = e=> { console.error("WS err", e); }
 ws.onmessage = (evt)=>{
   try {
+    if(evt.data instanceof ArrayBuffer){
+      const data = decodeStateFrame(evt.data);
+      if(data) renderState(data);
+      return;
+    }
     const data = JSON.parse(evt.data);
     if(data.type === "state" && data.loads){
-      data.loads.forEach((L)=>{
-        const i = L.id;
-        document.getElementById("v"+i).innerText = Number(L.voltage||0).toFixed(2)+" V";
-        document.getElementById("c"+i).innerText = Number(L.current||0).toFixed(3)+" A";
-        document.getElementById("p"+i).innerText = Number(L.power||0).toFixed(2)+" W";
-        document.getElementById("e"+i).innerText = Number(L.energy||0).toFixed(2)+" Wh";
-        document.getElementById("s"+i).innerText = L.relay ? "ON" : "OFF";
-        document.getElementById("relay"+i).checked = !!L.relay;
-      });
-      if(data.unitPrice) document.getElementById("price").value = data.unitPrice;
+      renderState(data);
     } else if(data.type === "notification"){
-      prependNotif({ts: Date.now()/1000, text: data.text});
+      prependNotif({ts: data.ts || Date.now()/1000, text: data.text});
     }
   } catch(e){
     console.error("WS parse error", e);
@@ -140,7 +256,7 @@ function prependNotif(n){
 // Initial load of notifs and settings
 (async function init(){
   try {
-    const r = await fetch("/notifs.json"); if(r.ok){ const j = await r.json(); showNotifs(j.notifs || []); }
+    const r = await fetch("/api/notifs?limit=50"); if(r.ok){ const j = await r.json(); showNotifs(j.notifs || []); }
     const s = await fetch("/settings.json"); if(s.ok){ const js = await s.json(); document.getElementById("price").value = js.unitPrice || 8; }
   } catch(e){ console.warn("Init fetch failed", e); }
 })();
@@ -0,0 +1,151 @@
+// chart-lite.js - canvas bar / line chart for the history view
+// Implements the part of the Chart.js 4 API that app.js uses, so an upstream
+// Chart.js build can take its place without touching app.js:
+//   new Chart(ctx, {type: "line"|"bar", data: {labels, datasets: [{label, data}]},
+//                   options: {responsive, plugins: {legend: {display}}}})
+//   chart.destroy(), chart.toBase64Image(type, quality)
+// The background is painted white, so a JPEG export has no black ground.
+(function(global){
+  "use strict";
+  const COLORS = ["#36a2eb", "#ff6384", "#4bc0c0", "#ff9f40", "#9966ff", "#ffcd56"];
+  const FONT = "12px sans-serif";
+  const PAD = 8, LEGEND_ROW = 18, BOX = 12, ASPECT = 2;   // Chart.js default aspect ratio
+
+  // 1, 2 or 5 times a power of ten, giving about `ticks` steps over range.
+  function niceStep(range, ticks){
+    const raw = range/ticks;
+    const mag = Math.pow(10, Math.floor(Math.log10(raw)));
+    const f = raw/mag;
+    return (f <= 1 ? 1 : f <= 2 ? 2 : f <= 5 ? 5 : 10)*mag;
+  }
+
+  function Chart(ctx, config){
+    this.ctx = ctx.getContext ? ctx.getContext("2d") : ctx;
+    this.canvas = this.ctx.canvas;
+    this.config = config;
+    const opts = config.options || {};
+    this.onResize = null;
+    if(opts.responsive){
+      this.onResize = () => { this.fit(); this.draw(); };
+      global.addEventListener("resize", this.onResize);
+    }
+    this.fit();
+    this.draw();
+  }
+
+  // Responsive charts follow their container's width at a 2:1 aspect, in
+  // device pixels so lines stay sharp.
+  Chart.prototype.fit = function(){
+    const c = this.canvas;
+    this.dpr = 1;
+    if(!(this.config.options || {}).responsive || !c.parentNode){ this.w = c.width; this.h = c.height; return; }
+    const w = c.parentNode.clientWidth || this.w || c.width, h = Math.round(w/ASPECT);
+    this.dpr = global.devicePixelRatio || 1;
+    c.style.width = w + "px"; c.style.height = h + "px";
+    c.width = Math.round(w*this.dpr); c.height = Math.round(h*this.dpr);
+    this.w = w; this.h = h;
+  };
+
+  Chart.prototype.draw = function(){
+    const c = this.ctx, w = this.w, h = this.h;
+    const data = this.config.data || {}, bar = this.config.type === "bar";
+    const labels = data.labels || [], sets = data.datasets || [];
+    c.setTransform(this.dpr, 0, 0, this.dpr, 0, 0);
+    c.fillStyle = "#fff"; c.fillRect(0, 0, w, h);
+    c.font = FONT; c.textBaseline = "middle"; c.lineWidth = 1;
+
+    // Legend: centred rows of swatch + label, shown unless turned off.
+    let top = PAD;
+    const legend = ((this.config.options || {}).plugins || {}).legend;
+    if(sets.length && (!legend || legend.display !== false)){
+      const items = sets.map((s, k) => ({ k, text: String(s.label || ""), w: BOX + 6 + c.measureText(String(s.label || "")).width }));
+      const rows = [[]];
+      let used = 0;
+      items.forEach(it => {
+        if(used && used + it.w > w - 2*PAD){ rows.push([]); used = 0; }
+        rows[rows.length-1].push(it); used += it.w + 12;
+      });
+      rows.forEach(row => {
+        let x = (w - row.reduce((s, it) => s + it.w + 12, -12))/2;
+        const y = top + LEGEND_ROW/2;
+        row.forEach(it => {
+          c.fillStyle = COLORS[it.k % COLORS.length];
+          c.fillRect(x, y - BOX/2, BOX, BOX);
+          c.fillStyle = "#666"; c.textAlign = "left";
+          c.fillText(it.text, x + BOX + 6, y);
+          x += it.w + 12;
+        });
+        top += LEGEND_ROW;
+      });
+      top += 4;
+    }
+
+    // Value axis from zero (or below, for negatives), on round steps.
+    let lo = 0, hi = 0, n = labels.length;
+    sets.forEach(s => {
+      (s.data || []).forEach(v => { if(v > hi) hi = v; if(v < lo) lo = v; });
+      n = Math.max(n, (s.data || []).length);
+    });
+    if(hi === lo) hi = lo + 1;
+    const step = niceStep(hi - lo, 5), dec = Math.max(0, -Math.floor(Math.log10(step)));
+    lo = Math.floor(lo/step)*step; hi = Math.ceil(hi/step)*step;
+    const ticks = [];
+    for(let v = lo; v <= hi + step/2; v += step) ticks.push(v.toFixed(dec));
+    const left = PAD + Math.max.apply(null, ticks.map(t => c.measureText(t).width)) + 6;
+    const right = w - PAD, bottom = h - PAD - (n ? 16 : 0);
+    const yOf = v => bottom - (v - lo)/(hi - lo)*(bottom - top);
+
+    c.textAlign = "right";
+    ticks.forEach(t => {
+      const y = Math.round(yOf(+t)) + 0.5;
+      c.strokeStyle = "#e5e5e5"; c.beginPath(); c.moveTo(left, y); c.lineTo(right, y); c.stroke();
+      c.fillStyle = "#666"; c.fillText(t, left - 6, y);
+    });
+    if(!n) return;
+
+    // Category axis: one slot per label, labels thinned so they don't overlap.
+    const slot = (right - left)/n, xOf = i => left + slot*(i + 0.5);
+    const widest = labels.reduce((m, l) => Math.max(m, c.measureText(String(l)).width), 0);
+    const every = Math.max(1, Math.ceil((widest + 8)/slot));
+    c.textAlign = "center"; c.fillStyle = "#666";
+    for(let i = 0; i < labels.length; i += every) c.fillText(String(labels[i]), xOf(i), bottom + 10);
+
+    const zero = yOf(Math.max(lo, Math.min(0, hi)));
+    sets.forEach((s, k) => {
+      const col = COLORS[k % COLORS.length], d = s.data || [];
+      c.strokeStyle = col; c.fillStyle = col;
+      if(bar){
+        const bw = slot*0.8/sets.length;
+        d.forEach((v, i) => {
+          if(v == null) return;
+          const x = left + slot*i + slot*0.1 + bw*k, y = yOf(v);
+          c.globalAlpha = 0.5; c.fillRect(x, Math.min(y, zero), bw, Math.abs(zero - y));
+          c.globalAlpha = 1; c.strokeRect(x + 0.5, Math.min(y, zero) + 0.5, bw - 1, Math.abs(zero - y));
+        });
+      } else {
+        c.lineWidth = 2; c.beginPath();
+        let pen = false;
+        d.forEach((v, i) => {
+          if(v == null){ pen = false; return; }
+          if(pen) c.lineTo(xOf(i), yOf(v)); else c.moveTo(xOf(i), yOf(v));
+          pen = true;
+        });
+        c.stroke(); c.lineWidth = 1;
+        d.forEach((v, i) => { if(v != null){ c.beginPath(); c.arc(xOf(i), yOf(v), 2.5, 0, 2*Math.PI); c.fill(); } });
+      }
+    });
+    c.globalAlpha = 1;
+  };
+
+  Chart.prototype.destroy = function(){
+    if(this.onResize) global.removeEventListener("resize", this.onResize);
+    this.ctx.setTransform(1, 0, 0, 1, 0, 0);
+    this.ctx.clearRect(0, 0, this.canvas.width, this.canvas.height);
+  };
+
+  Chart.prototype.toBase64Image = function(type, quality){
+    return this.canvas.toDataURL(type || "image/png", quality);
+  };
+
+  global.Chart = Chart;
+})(window);
@@ -0,0 +1,104 @@
+// pdf-lite.js - one-page PDF report writer
+// Implements the part of the jsPDF 2 API that app.js uses, so an upstream
+// jsPDF build can take its place without touching app.js:
+//   const { jsPDF } = window.jspdf; const doc = new jsPDF();   // A4 portrait, mm
+//   doc.text(str, x, y); doc.addImage(jpegDataUrl, "JPEG", x, y, w, h); doc.save(name)
+// Text is 16 pt Helvetica in WinAnsi; characters outside Latin-1 print as
+// "?". Images are JPEG only, embedded as they are (DCTDecode).
+(function(global){
+  "use strict";
+  const PT = 72/25.4, PAGE_W = 595.28, PAGE_H = 841.89;   // A4 in points
+
+  const num = v => String(Math.round(v*100)/100);
+
+  // A PDF literal string; one byte per character.
+  function pdfString(s){
+    let out = "";
+    for(const ch of String(s)){
+      const c = ch.codePointAt(0);
+      if(c === 0x28 || c === 0x29 || c === 0x5c) out += "\\" + ch;
+      else out += c < 32 || c > 255 ? "?" : ch;
+    }
+    return "(" + out + ")";
+  }
+
+  // Size and colour components from the first SOFn marker.
+  function jpegInfo(bin){
+    let o = 2;
+    while(o + 9 < bin.length){
+      if(bin.charCodeAt(o) !== 0xFF){ o++; continue; }
+      const m = bin.charCodeAt(o+1), len = bin.charCodeAt(o+2)*256 + bin.charCodeAt(o+3);
+      if(m >= 0xC0 && m <= 0xCF && m !== 0xC4 && m !== 0xC8 && m !== 0xCC)
+        return { h: bin.charCodeAt(o+5)*256 + bin.charCodeAt(o+6),
+                 w: bin.charCodeAt(o+7)*256 + bin.charCodeAt(o+8), n: bin.charCodeAt(o+9) };
+      o += 2 + len;
+    }
+    throw new Error("addImage: not a JPEG");
+  }
+
+  function jsPDF(){
+    this.ops = [];
+    this.images = [];
+    this.fontSize = 16;
+  }
+
+  jsPDF.prototype.setFontSize = function(pt){ this.fontSize = pt; return this; };
+
+  // x, y: mm from the top left; y is the baseline.
+  jsPDF.prototype.text = function(s, x, y){
+    this.ops.push("BT /F1 " + this.fontSize + " Tf " + num(x*PT) + " " + num(PAGE_H - y*PT) + " Td " + pdfString(s) + " Tj ET");
+    return this;
+  };
+
+  jsPDF.prototype.addImage = function(data, format, x, y, w, h){
+    if(!/^jpe?g$/i.test(format)) throw new Error("addImage: only JPEG is supported");
+    const bin = atob(String(data).replace(/^data:[^,]*,/, ""));
+    const name = "Im" + (this.images.length + 1);
+    this.images.push({ name, bin, info: jpegInfo(bin) });
+    this.ops.push("q " + num(w*PT) + " 0 0 " + num(h*PT) + " " + num(x*PT) + " " + num(PAGE_H - (y+h)*PT) + " cm /" + name + " Do Q");
+    return this;
+  };
+
+  // The whole file as a binary string, one character per byte.
+  jsPDF.prototype.output = function(){
+    const objs = [];
+    const add = body => objs.push(body);              // returns the object number
+    const catalog = add(""), pages = add(""), page = add("");
+    const font = add("<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica /Encoding /WinAnsiEncoding >>");
+    const xobj = this.images.map(im => add(
+      "<< /Type /XObject /Subtype /Image /Width " + im.info.w + " /Height " + im.info.h +
+      " /ColorSpace /" + (im.info.n === 1 ? "DeviceGray" : im.info.n === 4 ? "DeviceCMYK" : "DeviceRGB") +
+      " /BitsPerComponent 8 /Filter /DCTDecode /Length " + im.bin.length + " >>\nstream\n" + im.bin + "\nendstream"));
+    const ops = this.ops.join("\n");
+    const content = add("<< /Length " + ops.length + " >>\nstream\n" + ops + "\nendstream");
+    objs[catalog-1] = "<< /Type /Catalog /Pages " + pages + " 0 R >>";
+    objs[pages-1] = "<< /Type /Pages /Kids [" + page + " 0 R] /Count 1 >>";
+    objs[page-1] = "<< /Type /Page /Parent " + pages + " 0 R /MediaBox [0 0 " + PAGE_W + " " + PAGE_H + "]" +
+      " /Contents " + content + " 0 R /Resources << /Font << /F1 " + font + " 0 R >> /XObject << " +
+      this.images.map((im, k) => "/" + im.name + " " + xobj[k] + " 0 R").join(" ") + " >> >> >>";
+
+    let out = "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n";
+    const offsets = objs.map((body, k) => {
+      const at = out.length;
+      out += (k+1) + " 0 obj\n" + body + "\nendobj\n";
+      return at;
+    });
+    const xref = out.length;
+    out += "xref\n0 " + (objs.length+1) + "\n0000000000 65535 f \n" +
+           offsets.map(o => String(o).padStart(10, "0") + " 00000 n \n").join("");
+    out += "trailer\n<< /Size " + (objs.length+1) + " /Root " + catalog + " 0 R >>\nstartxref\n" + xref + "\n%%EOF\n";
+    return out;
+  };
+
+  jsPDF.prototype.save = function(filename){
+    const s = this.output(), bytes = new Uint8Array(s.length);
+    for(let i = 0; i < s.length; i++) bytes[i] = s.charCodeAt(i);
+    const url = URL.createObjectURL(new Blob([bytes], { type: "application/pdf" }));
+    const a = document.createElement("a");
+    a.href = url; a.download = filename || "generated.pdf";
+    document.body.appendChild(a); a.click(); a.remove();
+    setTimeout(() => URL.revokeObjectURL(url), 1000);
+  };
+
+  global.jspdf = { jsPDF };
+})(window);
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <FS.h>
+#include "sampler.h"
+#include "demand.h"
+
+// ---------------- Energy checkpoints ----------------
+// The sampler's energy, cost and on-time counters, and the day's and month's
+// demand peaks, survive resets two ways:
+// every tick into RTC memory (kept across watchdog, brownout and software
+// resets), and every checkpointSec into a fixed-slot ring in one
+// preallocated file. Flash records go to consecutive slots, so the writes
+// walk the whole file and SPIFFS spreads them further. Both copies carry
+// a sequence number and CRC. At boot the newest valid one is restored
+// before the sampler starts.
+//
+// Flash cost is one 240 B record per checkpointSec: the default 300 s is
+// 288 writes a day and loses at most 5 min of counting to a power cut.
+
+const uint16_t CKPT_SLOTS = 64;
+const uint16_t CKPT_SEC_DEFAULT = 300;
+const uint16_t CKPT_SEC_MIN = 30;
+const uint16_t CKPT_SEC_MAX = 3600;
+const uint32_t CKPT_MAGIC = 0x50544333;   // "PTC3"
+
+inline uint16_t clampCheckpointSec(long s){ return s<CKPT_SEC_MIN ? CKPT_SEC_MIN : s>CKPT_SEC_MAX ? CKPT_SEC_MAX : s; }
+
+struct CheckpointRec {
+  uint32_t seq;                  // shared by RTC and flash copies; 0 = empty
+  uint32_t epoch;                // wall clock when taken, s (small if unsynced)
+  uint32_t onSec[NUM_LOADS];     // today
+  int64_t uWh[NUM_LOADS];        // lifetime
+  int64_t costMilli[NUM_LOADS];
+  int64_t uWhToday[NUM_LOADS];
+  int64_t costToday[NUM_LOADS];
+  uint32_t dayPeakMw[DEMAND_CHANNELS];   // loads, then the panel; of day
+  uint32_t dayPeakAt[DEMAND_CHANNELS];
+  uint32_t monthPeakMw[DEMAND_CHANNELS];
+  uint32_t monthPeakAt[DEMAND_CHANNELS];
+  uint32_t magic;
+  uint16_t day;                  // local day of the daily counters, 0 = unknown
+  uint16_t crc;                  // CRC-16 over the first 238 bytes
+};
+static_assert(sizeof(CheckpointRec)==240, "record layout");
+
+extern volatile uint16_t checkpointSec;
+
+class Checkpoints {
+public:
+  // Opens (creating / resizing if needed) the ring and finds the newest record.
+  bool begin(const char* path);
+  // Seeds the sampler and the demand peaks from the newest of the RTC and
+  // flash copies. Returns
+  // "rtc", "flash" or nullptr if there was nothing to restore.
+  const char* restore();
+  // Once a tick: refreshes the RTC copy, and writes to flash when
+  // checkpointSec has passed since the last flash write.
+  void tick(uint32_t epoch, const Readings &s);
+
+  const CheckpointRec& last() const { return rec; }   // newest, RTC or flash
+  uint32_t writes = 0;                                // flash records written
+
+private:
+  bool format();
+  void fill(uint32_t epoch, const Readings &s);
+
+  const char* path = nullptr;
+  File f;
+  CheckpointRec rec;                // newest record, flash or RTC
+  CheckpointRec flashRec;           // newest valid flash record
+  uint16_t nextSlot = 0;
+  uint32_t lastWriteMs = 0;
+};
+
+extern Checkpoints checkpoints;
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include "sampler.h"
+#include "timerwheel.h"
+#include "demand.h"
+
+// ---------------- Relay control ----------------
+// Auto-OFF, delayed-ON, usage-limit cutoffs and the daily schedule are
+// timers on the monotonic wheel (timerwheel.h), driven by loop() through
+// timers.advance(); nothing here polls per tick.
+struct Load {
+  volatile bool relay=false;  // read by the sampler
+  unsigned long usageLimitSeconds=12UL*3600;
+  int timerMinutes=0;
+  unsigned long timerEndEpoch=0;  // auto-OFF time, for display only
+  int32_t onAt=-1, offAt=-1;      // daily schedule, s into the local day, -1 = none
+  uint8_t shed=0;                 // demand-limit shedding order, highest first; 0 = never
+
+  Timer offTimer, onTimer, limitTimer, schedOn, schedOff;
+};
+extern Load L[NUM_LOADS];
+extern volatile uint32_t demandLimitW;  // panel demand limit, 0 = none
+
+void controlBegin();
+// Manual switch; arms the auto-OFF timer and the limit cutoff when switching
+// on, and drops a pending delayed-ON.
+void relayCommand(uint8_t i, bool on, uint32_t epoch);
+void setTimer(uint8_t i, int minutes, uint32_t epoch);
+void setLimit(uint8_t i, unsigned long seconds);
+// Switches the load on in `minutes`; 0 cancels.
+void delayOn(uint8_t i, int minutes);
+void setSchedule(uint8_t i, int32_t onAt, int32_t offAt);
+// Once per second: arms the daily schedule once the wall clock is valid.
+void controlTick(uint32_t epoch);
+// After each demand bucket: warns at 90% of demandLimitW and, at the limit,
+// sheds the ON load with the highest `shed` while the last minute's power is
+// still over it (the window average lags, so it cannot be the trigger alone).
+void demandControl(const DemandMeter &d);
+// The wall clock just stepped (NTP sync after a boot that started timers on
+// the unsynced clock): moves the displayed auto-OFF times and re-aims the
+// schedule. Wheel timers themselves are unaffected.
+void shiftTimers(int32_t step);
+
+// Defined by the firmware (log, store, broadcast) or the simulator.
+void pushNotification(const char* text);
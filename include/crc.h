@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Small bitwise CRCs for flash records; no tables, these run a few times a second.
+
+// CRC-8, poly 0x07.
+inline uint8_t crc8(const uint8_t* p, size_t n){
+  uint8_t c = 0;
+  while(n--){
+    c ^= *p++;
+    for(int k=0;k<8;k++) c = (c & 0x80) ? (uint8_t)((c<<1) ^ 0x07) : (uint8_t)(c<<1);
+  }
+  return c;
+}
+
+// CRC-16/CCITT-FALSE.
+inline uint16_t crc16(const uint8_t* p, size_t n){
+  uint16_t c = 0xFFFF;
+  while(n--){
+    c ^= (uint16_t)(*p++) << 8;
+    for(int k=0;k<8;k++) c = (c & 0x8000) ? (uint16_t)((c<<1) ^ 0x1021) : (uint16_t)(c<<1);
+  }
+  return c;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <FS.h>
+#include "sampler.h"
+#include "demand.h"
+
+// ---------------- Daily ledger ----------------
+// One record per closed local day with each load's energy, on-time and
+// cost, as counted by the sampler (so it includes time the clock was not
+// yet synced, which the time-series store never sees), and the day's peak
+// demand per load and for the panel. Day d lives in slot d % DAY_SLOTS of
+// one preallocated file: a write is one seek and one 128 B write, a lookup
+// one seek and one read, and the ring holds just over a year.
+
+const uint16_t DAY_SLOTS = 384;
+
+struct DayRecord {
+  uint32_t day;                 // local day, days since 1970; 0 = empty
+  uint32_t onSec[NUM_LOADS];
+  uint32_t rsv;
+  int64_t uWh[NUM_LOADS];
+  int64_t costMilli[NUM_LOADS];
+  uint32_t peakMw[DEMAND_CHANNELS];   // loads, then the panel
+  uint16_t peakMin[DEMAND_CHANNELS];  // minute of the day, DEMAND_NO_MINUTE = none
+  uint8_t pad[8];
+  uint16_t crc;                 // CRC-16 over the first 126 bytes
+};
+static_assert(sizeof(DayRecord)==128, "record layout");
+
+class DayLog {
+public:
+  // Opens (creating / resizing if needed) the ledger.
+  bool begin(const char* path);
+  // peaks may be null (no demand figures for the day).
+  bool write(const DayTotals &d, const DemandDay *peaks);
+  // Record of day, false if the ledger does not hold it.
+  bool read(uint16_t day, DayRecord &out);
+
+  uint32_t writes = 0;          // records written
+
+private:
+  bool format();
+
+  const char* path = nullptr;
+  File f;
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+
+// Coalesces a burst of changes into one write: due once quietMs pass with no
+// further change, or maxDelayMs after the first unsaved change, whichever
+// comes first. Times are millis() and wrap safely.
+class Debouncer {
+public:
+  Debouncer(uint32_t quietMs, uint32_t maxDelayMs) : quiet(quietMs), maxDelay(maxDelayMs) {}
+
+  void touch(uint32_t now){
+    if(dirty) coalesced++;
+    else { dirty = true; first = now; }
+    last = now;
+  }
+  bool due(uint32_t now) const {
+    return dirty && (now-last >= quiet || now-first >= maxDelay);
+  }
+  void done(){ dirty = false; writes++; }
+  bool pending() const { return dirty; }
+
+  uint32_t writes = 0;     // flushes performed
+  uint32_t coalesced = 0;  // changes folded into another flush (writes avoided)
+
+private:
+  uint32_t quiet, maxDelay;
+  uint32_t first = 0, last = 0;
+  bool dirty = false;
+};
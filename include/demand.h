@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include "sampler.h"
+
+// ---------------- Peak demand ----------------
+// Demand is average power over a sliding window (15 or 30 min), which is
+// what maximum-demand tariffs bill. Energy goes into one-minute buckets kept
+// in a ring per channel (each load, then the panel total) with a running
+// sum over the window, so a second costs one add per channel and a minute
+// one add and one subtract, whatever the window length.
+//
+// Daily and monthly peaks carry the time the peaking window ended. A day's
+// peaks go to the daily ledger when it closes. Both sets ride in the energy
+// checkpoint (checkpoint.h) and are restored at boot; without one the
+// monthly peak is rebuilt from the ledger.
+
+const uint8_t DEMAND_CHANNELS = NUM_LOADS+1;
+const uint8_t DEMAND_TOTAL = NUM_LOADS;      // channel index of the panel
+const uint32_t DEMAND_BUCKET_MS = 60000;
+const uint8_t DEMAND_BUCKETS = 30;           // longest window, minutes
+const uint8_t DEMAND_WINDOW_DEFAULT = 15;
+const uint16_t DEMAND_NO_MINUTE = 0xFFFF;
+
+inline uint8_t clampDemandWindow(int m){ return m<=15 ? 15 : 30; }
+
+extern volatile uint8_t demandWindowMin;
+
+struct DemandPeak {
+  uint32_t mW = 0;
+  uint32_t at = 0;             // epoch the window ended, 0 = clock unsynced
+};
+
+// One closed day's peaks as the ledger stores them.
+struct DemandDay {
+  uint16_t day = 0;            // 0 = none
+  uint32_t mW[DEMAND_CHANNELS];
+  uint16_t minute[DEMAND_CHANNELS];   // of the local day, DEMAND_NO_MINUTE = none
+};
+
+class DemandMeter {
+public:
+  // Once a second from the loop with the sampler's counters. True when a
+  // bucket closed and the demand figures moved.
+  bool tick(uint32_t tnow, const Readings &s);
+  // Window filled: demand and peaks are over whole windows from here on.
+  bool full() const { return filled>=window; }
+  uint8_t windowMin() const { return window; }
+  // Before the first tick: peaks checkpointed on local day d (0 = none).
+  void restore(uint16_t d, const DemandPeak* today, const DemandPeak* month);
+
+  uint32_t demandMw[DEMAND_CHANNELS] = {};  // over the current window
+  uint32_t lastMw[DEMAND_CHANNELS] = {};    // over the last bucket alone
+  DemandPeak today[DEMAND_CHANNELS];
+  DemandPeak month[DEMAND_CHANNELS];
+  DemandDay closed;                         // the most recent day closed out
+
+private:
+  void closeBucket(uint32_t tnow);
+  void newDay(uint16_t d);
+  void resum();
+
+  uint32_t bucket[DEMAND_CHANNELS][DEMAND_BUCKETS] = {};  // uWh
+  uint64_t sum[DEMAND_CHANNELS] = {};
+  uint32_t cur[DEMAND_CHANNELS] = {};
+  int64_t lastUWh[NUM_LOADS] = {};
+  uint32_t bucketStart = 0;
+  uint8_t head = 0, filled = 0, window = DEMAND_WINDOW_DEFAULT;
+  uint16_t day = 0, monthNo = 0;
+  bool primed = false;
+};
+
+extern DemandMeter demand;
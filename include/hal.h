@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ---------------- Hardware abstraction ----------------
+// The only way the core logic (sampler, control, settings) touches the board.
+// src/hal_esp32.cpp backs it with the INA219s, relay GPIOs and ESP32 clocks;
+// src/sim/hal_sim.cpp with simulated sensors, relays and a virtual clock.
+const uint32_t EPOCH_VALID = 1600000000;   // anything earlier means NTP hasn't synced
+
+namespace hal {
+  uint32_t millis();
+  uint32_t micros();
+  uint32_t epoch();                 // wall clock, s; small until NTP has synced
+  uint32_t cycles();                // free-running CPU cycle counter, wraps
+  uint32_t cyclesPerUs();
+
+  void initRelays();                // all outputs OFF
+  void setRelay(uint8_t i, bool on);
+
+  bool initSensor(uint8_t i);       // true if the sensor answered
+  bool readSensor(uint8_t i, float &volts, float &amps);
+
+  // Memory that survives warm resets (watchdog, brownout, software); holds
+  // garbage after power-on, so callers validate what they load.
+  const size_t RTC_BYTES = 256;
+  bool rtcLoad(void* out, size_t n);
+  void rtcStore(const void* in, size_t n);
+
+  void logf(const char* fmt, ...);
+}
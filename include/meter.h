@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// ---------------- Window statistics ----------------
+struct Stat { float min=0, max=0, mean=0, rms=0; };
+
+// Running min/max/sum/sum-of-squares, O(1) per sample.
+struct Agg {
+  float mn=0, mx=0, sum=0, sq=0;
+  uint32_t n=0;
+  void reset(){ mn=mx=sum=sq=0; n=0; }
+  void add(float x){
+    if(!n || x<mn) mn=x;
+    if(!n || x>mx) mx=x;
+    sum+=x; sq+=x*x; n++;
+  }
+  Stat stat() const;
+};
+
+struct WindowStats { Stat v, i, p; uint32_t n=0; };
+
+// Published per load at every window close.
+struct Reading {
+  WindowStats w;        // last closed window; w.v/w.i/w.p.mean are V/I/P
+  int64_t uWh=0;        // energy, micro-watt-hours
+  int64_t costMilli=0;  // cost, milli-currency
+  int64_t uWhToday=0;   // since local midnight
+  int64_t costToday=0;
+  unsigned long onSecondsToday=0;
+};
+
+// ---------------- Raw sample ring ----------------
+struct RawSample { uint32_t tUs; float v, i; };
+
+// Single-producer ring that overwrites its oldest entry when full.
+// Readers never block the producer; copies that race an overwrite are trimmed.
+template<size_t N>
+class SampleRing {
+public:
+  void push(const RawSample& s){
+    uint32_t h = head.load(std::memory_order_relaxed);
+    buf[h % N] = s;
+    head.store(h+1, std::memory_order_release);
+  }
+
+  // Copies up to max of the newest samples, oldest first. Returns the count.
+  size_t latest(RawSample* out, size_t max) const {
+    uint32_t h = head.load(std::memory_order_acquire);
+    uint32_t avail = h < N ? h : N;
+    if(max > avail) max = avail;
+    uint32_t first = h - max;
+    for(size_t k=0;k<max;k++) out[k] = buf[(first+k) % N];
+    // The producer may have lapped us while copying (including the slot it
+    // is writing right now); drop the oldest entries it could have touched.
+    uint32_t moved = head.load(std::memory_order_acquire) - h;
+    size_t lost = moved + 1 + max > N ? moved + 1 + max - N : 0;
+    if(lost > max) lost = max;
+    if(lost){
+      for(size_t k=lost;k<max;k++) out[k-lost] = out[k];
+      max -= lost;
+    }
+    return max;
+  }
+
+  uint32_t total() const { return head.load(std::memory_order_relaxed); }
+
+private:
+  RawSample buf[N];
+  std::atomic<uint32_t> head{0};
+};
+
+// ---------------- Energy / cost ----------------
+// Integer accumulators. Each step is the trapezoid between two power
+// readings in mW over the measured interval in us, kept doubled (2*nJ) so
+// the halving is exact; remainders are carried so nothing is lost to
+// rounding and no double-precision (soft-float on ESP32) math runs per sample.
+struct EnergyAcc {
+  int64_t uWh = 0;        // micro-watt-hours
+  int64_t costMilli = 0;  // milli-currency
+  uint32_t eRem = 0;      // 2*mW*us short of one uWh (< 7.2e6)
+  uint32_t cRem = 0;      // uWh*milli-price short of one milli-currency (< 1e9)
+
+  void add(uint32_t p0mW, uint32_t p1mW, uint32_t dtUs, uint32_t priceMilli){
+    uint64_t e = (uint64_t)(p0mW + p1mW)*dtUs + eRem;
+    uint64_t du = e / 7200000u;
+    eRem = (uint32_t)(e - du*7200000u);
+    uWh += du;
+    uint64_t c = du*priceMilli + cRem;
+    uint64_t dc = c / 1000000000u;
+    cRem = (uint32_t)(c - dc*1000000000u);
+    costMilli += dc;
+  }
+};
+
+// ---------------- Per-load channel ----------------
+const size_t RING_SAMPLES = 256;
+
+// Sampler-private state for one load: window aggregates, energy, raw history.
+class Channel {
+public:
+  // Integrates from the previous sample using the real tUs delta.
+  void add(uint32_t tUs, float v, float i, uint32_t priceMilli);
+  WindowStats closeWindow();
+
+  EnergyAcc energy;
+  SampleRing<RING_SAMPLES> ring;
+
+private:
+  Agg av, ai, ap;
+  bool primed = false;
+  uint32_t lastUs = 0, lastPmW = 0;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ---------------- Loop metrics ----------------
+// Fixed-bucket latency histograms, fed from the CPU cycle counter around
+// each phase of loop() and the sampler. Recording is a counter read, a
+// subtraction and a short bucket scan, cheap enough to leave on always.
+// Served as Prometheus text by /metrics. PH_INA is written by the sampler
+// task, so a scrape can read it mid-update and be off by one sample.
+
+enum Phase : uint8_t {
+  PH_WS,          // webSocket.loop()
+  PH_HTTP,        // server.handleClient()
+  PH_SETTINGS,    // debounced settings flush
+  PH_INA,         // one round of sensor reads and integration (sampler task)
+  PH_CONTROL,     // timer wheel expiries, schedule arming
+  PH_HISTORY,     // time-series ingest and energy checkpoint
+  PH_BROADCAST,   // broadcastState()
+  PHASE_COUNT
+};
+extern const char* const PHASE_NAMES[PHASE_COUNT];
+
+// Upper bounds in µs; one more bucket catches everything above.
+const uint8_t HIST_BUCKETS = 16;
+extern const uint32_t HIST_BOUNDS_US[HIST_BUCKETS];
+
+struct Histogram {
+  uint64_t counts[HIST_BUCKETS+1] = {0};
+  uint64_t count = 0;
+  uint64_t sumUs = 0;
+  uint32_t maxUs = 0;
+
+  void observe(uint32_t us);
+};
+
+extern Histogram phaseHist[PHASE_COUNT];
+extern Histogram tickLate;   // how far past its 1 s mark the tick ran
+
+// Boot milestones, ms since reset. Metering and relays come up before the
+// network, so first_sample should land within milliseconds of reset
+// whatever WiFi and NTP are doing.
+const uint32_t BOOT_PENDING = 0xFFFFFFFF;
+struct BootTimes {
+  uint32_t firstSample;      // first round of sensor reads (sampler task)
+  uint32_t firstBroadcast;   // first state tick of loop()
+  uint32_t wifi;             // station connected
+  uint32_t ntp;              // clock synced
+};
+extern BootTimes bootTimes;
+inline void bootMark(uint32_t &t, uint32_t ms){ if(t==BOOT_PENDING) t = ms; }
+
+// Records the phase that started at cycle c0 and returns the current cycle
+// count, so consecutive phases need one counter read each.
+uint32_t phaseDone(Phase p, uint32_t c0);
+
+// Prometheus text for one histogram (cumulative buckets, seconds). label
+// may be null. Output goes through emit in pieces of at most ~96 bytes.
+typedef void (*MetricsEmit)(const char* s, size_t n, void* ctx);
+void writeHistogram(const char* name, const char* label, const Histogram &h, MetricsEmit emit, void* ctx);
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <FS.h>
+
+// ---------------- Notification log ----------------
+// Fixed-slot circular log in one preallocated file. Entry seq lives in slot
+// seq % NOTIF_SLOTS, so an append is one seek and one 64 B write no matter
+// how many entries exist; the oldest entry is overwritten once the ring is
+// full. Sequence numbers keep counting across clears and reboots, so
+// clients can page with "everything after seq N": clear() leaves one marker
+// slot holding the last seq, which begin() counts but never returns.
+
+const uint16_t NOTIF_SLOTS = 256;
+const size_t NOTIF_TEXT_LEN = 53;
+const uint8_t NOTIF_CLEARED = 0xFF;   // len of the marker slot
+
+struct NotifSlot {
+  uint32_t seq;                 // 0 = empty
+  uint32_t ts;                  // epoch s
+  uint8_t len;
+  char text[NOTIF_TEXT_LEN];    // not NUL-terminated when full
+  uint16_t crc;                 // CRC-16 over the first 62 bytes
+};
+static_assert(sizeof(NotifSlot)==64, "slot layout");
+
+class NotifLog {
+public:
+  // Opens (creating / resizing if needed) the log and finds the newest seq.
+  bool begin(const char* path);
+  // Appends one entry, truncating text to NOTIF_TEXT_LEN. Returns its seq.
+  uint32_t append(uint32_t ts, const char* text);
+  // Drops every entry. Numbering continues, across a reboot too.
+  void clear();
+
+  // Reads up to max entries with seq > since, oldest first. Returns the
+  // count written to out.
+  size_t read(uint32_t since, NotifSlot* out, size_t max);
+
+  uint32_t last() const { return next-1; }   // newest seq, 0 if none
+  uint32_t first() const;                    // oldest seq still held
+
+  uint32_t writes = 0;                       // slot writes issued
+
+private:
+  bool readSlot(uint32_t seq, NotifSlot& out);
+  void writeSlot(NotifSlot& s);
+  bool format();
+
+  const char* path = nullptr;
+  File f;
+  uint32_t next = 1;
+  uint32_t clearedTo = 1;   // entries below this were cleared
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include "sampler.h"
+#include "tsdb.h"
+#include "daylog.h"
+
+// ---------------- History recorder ----------------
+extern TsStore history;
+extern DayLog days;
+
+// Mounts the history store and arms its flush every TS_FLUSH_MS on the
+// timer wheel (timers.begin() must have run).
+void recorderBegin(int32_t tzOffset);
+
+// Feeds one second of every load into the time-series store, as deltas of
+// the sampler's counters so a late tick still carries all of its energy.
+// Also writes each day the sampler closes out to the daily ledger, with its
+// demand peaks (demand.tick() must have seen the same Readings first).
+void recordHistory(uint32_t tnow, const Readings &s);
@@ -0,0 +1,96 @@
+#pragma once
+#include <stdint.h>
+#include "meter.h"
+#include "snapshot.h"
+#include "tariff.h"
+#include "hal.h"
+
+const uint8_t NUM_LOADS = 4;
+const uint16_t SAMPLE_HZ_DEFAULT = 50;
+const uint16_t SAMPLE_HZ_MAX = 200;
+const uint32_t WINDOW_MS = 1000;   // one aggregate per broadcast
+
+inline uint16_t clampSampleHz(int hz){ return hz<1 ? 1 : hz>SAMPLE_HZ_MAX ? SAMPLE_HZ_MAX : hz; }
+
+// Local calendar day, days since 1970; 0 while the clock is unsynced.
+// uint16_t lasts until 2149.
+inline uint16_t localDay(uint32_t epoch, int32_t tzOffset){
+  return epoch<EPOCH_VALID ? 0 : (uint16_t)((epoch+tzOffset)/86400);
+}
+
+// Calendar month of a day (days since 1970) as months since January 1970,
+// so %12 is the month (0 = January) and a change means a new month.
+inline uint16_t monthOfDay(uint32_t day){
+  uint32_t z = day+719468;                       // civil-from-days, era 400 y
+  uint32_t era = z/146097, doe = z%146097;
+  uint32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+  uint32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+  uint32_t mp = (5*doy+2)/153;                   // 0 = March
+  uint32_t y = era*400 + yoe + (mp>=10);
+  uint32_t m = mp<10 ? mp+2 : mp-10;             // 0 = January
+  return (uint16_t)((y-1970)*12 + m);
+}
+
+// One load-day as closed out by the midnight rollover.
+struct DayTotals {
+  uint16_t day = 0;             // 0 = none closed yet
+  uint32_t onSec[NUM_LOADS];
+  int64_t uWh[NUM_LOADS];
+  int64_t costMilli[NUM_LOADS];
+};
+
+// Measured values, written only by the sampler
+struct Readings {
+  Reading r[NUM_LOADS];
+  uint16_t day = 0;             // day the *Today counters belong to, 0 = unknown
+  DayTotals closed;             // the most recent day closed out
+};
+
+extern Snapshot<Readings> readings;
+extern Channel CH[NUM_LOADS];
+extern volatile uint16_t sampleHz;
+extern volatile uint32_t priceMilli;  // flat unit price per kWh, milli-currency
+
+// Owns the sensors and the energy accumulators. sample() is called sampleHz
+// times a second, by the sampling task on the board or by the simulator; it
+// folds each WINDOW_MS into min/max/mean/RMS and publishes to `readings`.
+//
+// Window close also runs the midnight rollover: one division per window
+// finds the local day, and when it changes the old day's totals go to
+// readings.closed and the daily counters restart, in the same publish.
+// Counters restored from an earlier day (device off across midnight) are
+// closed out as soon as the clock is valid.
+//
+// Each energy step is costed at the rate in effect when it was measured:
+// the time-of-use rate (tariff.h) while a schedule is set and the clock is
+// valid, else the flat priceMilli. The rate and the millis() at which it
+// next changes are worked out at that boundary, so a sample costs one
+// compare.
+class Sampler {
+public:
+  void begin();
+  void sample();
+  // Seeds the counters (from a checkpoint) and publishes them. Only before
+  // the sampling task starts.
+  void restore(const Readings &saved);
+
+  bool present[NUM_LOADS] = {false,false,false,false};
+  int32_t tzOffset = 0;         // local time for the rollover and tariff, s east of UTC
+  volatile uint32_t rateMilli = 0;  // rate in effect, per kWh
+  uint32_t reprices = 0;
+
+private:
+  void rollover(uint16_t today);
+  void reprice(uint32_t nowMs);
+
+  Readings acc;
+  uint64_t onUs[NUM_LOADS] = {0,0,0,0};
+  int64_t dayUWh[NUM_LOADS] = {0,0,0,0};    // lifetime counters at day start
+  int64_t dayCost[NUM_LOADS] = {0,0,0,0};
+  uint32_t windowStart = 0, lastUs = 0;
+  bool touActive = false;       // else the flat price
+  uint32_t touRate = 0;
+  uint32_t touUntilMs = 0;
+};
+
+extern Sampler sampler;
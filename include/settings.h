@@ -0,0 +1,15 @@
+#pragma once
+#include "debounce.h"
+
+// ---------------- Settings ----------------
+// Unit price, sample rate, checkpoint interval, demand window and limit, and
+// per-load limit/timer/schedule/shed order, kept in /settings.json.
+extern const char* SETTINGS_FILE;
+
+// Settings are flushed once changes go quiet, not once per command
+extern Debouncer settingsSave;
+
+void saveSettingsToFS();
+void loadSettingsFromFS();
+void markSettingsDirty();
+bool flushSettingsIfDue();   // true if it wrote
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Single-writer seqlock. The writer never blocks; a reader that races a
+// publish simply retries its copy. T must be trivially copyable.
+//
+// A reader spins while a publish is in progress, so the writer must not be
+// one it can preempt: here the sampler task writes and the lower-priority
+// loop() reads. For the other direction use Handoff.
+template<typename T>
+class Snapshot {
+public:
+  void publish(const T& v){
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    data = v;
+    std::atomic_thread_fence(std::memory_order_release);
+    seq.store(s+2, std::memory_order_release);
+  }
+
+  // Copies the latest value into out, returns its publish count.
+  uint32_t read(T& out) const {
+    for(;;){
+      uint32_t s = seq.load(std::memory_order_acquire);
+      if(s & 1) continue;
+      out = data;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(seq.load(std::memory_order_relaxed) == s) return s >> 1;
+    }
+  }
+
+  T read() const { T out; read(out); return out; }
+
+private:
+  std::atomic<uint32_t> seq{0};
+  T data{};
+};
+
+// Single-writer, single-reader handoff of the latest value, for a writer the
+// reader may preempt (loop() posting to the sampler task). Three buffers:
+// the writer fills its own and swaps it into the middle, the reader swaps
+// the middle for its own when there is something new. Neither side waits
+// on the other, on one core or two.
+template<typename T>
+class Handoff {
+public:
+  // Writer side.
+  void post(const T& v){
+    buf[back] = v;
+    back = mid.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+  }
+
+  // Reader side: takes the newest post, if any since the last take.
+  bool take(){
+    if(!(mid.load(std::memory_order_relaxed) & FRESH)) return false;
+    front = mid.exchange(front, std::memory_order_acq_rel) & 3;
+    return true;
+  }
+  // The value as of the last take; T{} before the first.
+  const T& latest() const { return buf[front]; }
+
+private:
+  static const uint8_t FRESH = 4;
+  T buf[3] {};
+  std::atomic<uint8_t> mid{1};
+  uint8_t back = 0;             // the writer's
+  uint8_t front = 2;            // the reader's
+};
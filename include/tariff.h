@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "snapshot.h"
+
+// ---------------- Time-of-use tariff ----------------
+// A schedule of rates by time of day, weekday/weekend and season, kept in
+// /tariff.json:
+//
+//   {"rates":[4.5,8,12.5],
+//    "seasons":[{"from":4,"weekday":"00:00=0 07:00=1 17:00=2 22:00=0","weekend":"00:00=0"},
+//               {"from":10,"weekday":"00:00=0 18:00=1"}]}
+//
+// rates are per kWh; a band runs from its HH:MM to the next band's, the
+// last wrapping past midnight to the first; "weekend" defaults to
+// "weekday"; a season runs from month `from` to the next season's start.
+// No file (or no seasons) means the flat unitPrice.
+//
+// The schedule is compiled into a table of rate indices per quarter hour,
+// so the sampler finds the rate in effect, and when it next changes, with
+// one short scan at each boundary and a single compare per sample between.
+
+const uint8_t TARIFF_RATES = 8;
+const uint8_t TARIFF_SEASONS = 4;
+const uint8_t TARIFF_BANDS = 12;        // per day type
+const uint16_t TARIFF_SLOT_SEC = 900;   // band starts round down to this
+const uint16_t TARIFF_DAY_SLOTS = 86400/TARIFF_SLOT_SEC;
+const uint32_t TARIFF_RECHECK_SEC = 3600;
+const double PRICE_MAX = 1000.0;        // per kWh, for the flat price and every rate
+
+// NaN fails both compares, so only a price lround() can take gets through.
+inline bool validPrice(double p){ return p>=0 && p<=PRICE_MAX; }
+
+struct TariffTable {
+  uint8_t seasons = 0;                  // 0 = no schedule
+  uint32_t rateMilli[TARIFF_RATES];     // milli-currency per kWh
+  uint8_t seasonOfMonth[12];
+  uint8_t slot[TARIFF_SEASONS][2][TARIFF_DAY_SLOTS];  // [season][weekend]
+
+  // Rate at epoch (local time via tzOffset) and the seconds it holds for,
+  // capped at TARIFF_RECHECK_SEC. False with no schedule or an unsynced
+  // clock, holdSec still set.
+  bool rateAt(uint32_t epoch, int32_t tzOffset, uint32_t &rate, uint32_t &holdSec) const;
+};
+
+extern const char* TARIFF_FILE;
+// Posted by loop(), taken by the sampler on its own task.
+extern Handoff<TariffTable> tariff;
+
+// nullptr on success, else what is wrong with the schedule.
+const char* compileTariff(const char* json, size_t n, TariffTable &out);
+// Compiles, stores and publishes a new schedule; no seasons removes it.
+const char* setTariff(const char* json, size_t n);
+void loadTariff();
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "meter.h"
+
+// Everything the state message carries for one load.
+struct LoadState {
+  uint8_t id=0;
+  Reading r;
+  bool relay=false;
+  uint32_t limitSec=0;
+  uint16_t timerMin=0;
+  uint32_t timerEnd=0;  // epoch, 0 = no timer armed
+  uint32_t demandMw=0;  // sliding-window demand (demand.h)
+  uint32_t peakMw=0;    // today's peak demand
+};
+
+// ---------------- Binary state frame ----------------
+// Little-endian, sent with broadcastBIN to clients that opted in.
+//
+// Header (16 B)
+//   0 u8  'P'   1 u8 'T'   2 u8 version   3 u8 load count
+//   4 u32 sequence         8 u32 unit price, milli-currency/kWh
+//  12 u16 sample rate, Hz 14 u16 flags (1 delta: only changed loads follow)
+// Load (80 B each)
+//   0 u8  id    1 u8 flags (1 relay, 2 timer armed)   2 u16 samples in window
+//   4 u16 V mean, mV       6 u16 V min, mV            8 u16 V max, mV
+//  10 u16 reserved
+//  12 u32 I mean, uA      16 u32 I min, uA           20 u32 I max, uA   24 u32 I rms, uA
+//  28 u32 P mean, mW      32 u32 P min, mW           36 u32 P max, mW
+//  40 u64 energy, uWh     48 i64 cost, milli-currency
+//  56 u32 on-time today, s    60 u32 limit, s        64 u32 timer end, epoch
+//  68 u16 timer, min      70 u16 reserved
+//  72 u32 demand, mW      76 u32 peak demand today, mW
+const uint8_t FRAME_VERSION = 2;
+const size_t FRAME_HEADER_LEN = 16;
+const size_t FRAME_LOAD_LEN = 80;
+
+enum : uint8_t { LOAD_RELAY = 1, LOAD_TIMER = 2 };
+enum : uint16_t { FRAME_DELTA = 1 };
+
+// Returns the frame length, or 0 if cap is too small. With changed set, only
+// loads with a non-zero field mask are packed and the frame is flagged delta.
+size_t encodeStateFrame(uint8_t* out, size_t cap, uint32_t seq, uint32_t priceMilli,
+                        uint16_t sampleHz, const LoadState* loads, uint8_t n,
+                        const uint16_t* changed = nullptr);
+
+// ---------------- Delta / deadband ----------------
+// Field groups of LoadState, used as per-load change masks.
+enum : uint16_t {
+  F_VOLT = 1, F_CURR = 2, F_POWER = 4, F_STATS = 8, F_ENERGY = 16, F_COST = 32,
+  F_RELAY = 64, F_ONSEC = 128, F_LIMIT = 256, F_TIMER = 512, F_DEMAND = 1024, F_ALL = 0x7FF
+};
+
+// A measured field counts as changed once it moves past max(rel*|sent|, abs)
+// from the value last sent; settings and relay state change on any edit.
+struct Deadband {
+  float rel = 0.005f;
+  float volt = 0.01f, curr = 0.001f, power = 0.05f;
+  int64_t uWh = 1000, costMilli = 1;
+};
+
+const uint8_t DELTA_MAX_LOADS = 8;
+
+// Remembers what was last sent so sub-deadband drift accumulates instead of
+// being lost tick by tick.
+class DeltaState {
+public:
+  Deadband band;
+
+  // Takes cur as the new baseline for every field.
+  void rebase(const LoadState* cur, uint8_t n, uint32_t priceMilli, uint16_t sampleHz);
+  // Fills changed[] and moves the baseline for the fields that changed.
+  // Returns true if anything at all needs sending.
+  bool diff(const LoadState* cur, uint8_t n, uint16_t* changed);
+  // Price / sample rate, reported once when they change.
+  bool globalsChanged(uint32_t priceMilli, uint16_t sampleHz);
+
+private:
+  LoadState sent[DELTA_MAX_LOADS];
+  uint32_t price = 0;
+  uint16_t hz = 0;
+  bool valid = false;
+};
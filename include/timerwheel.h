@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------- Timer wheel ----------------
+// Hierarchical timing wheel on the monotonic millis() clock, so timers run
+// the same whether or not NTP has set the wall clock, and are not moved when
+// it steps. WHEEL_LEVELS levels of WHEEL_SLOTS slots at WHEEL_TICK_MS
+// resolution reach about 19 days; anything further parks in the top level
+// and is re-placed when it cascades down.
+//
+// Timers are intrusive (embedded in their owner, no allocation) and sit on a
+// singly linked slot list with a back pointer, so arm and cancel are O(1).
+// advance() only visits the one level-0 slot per elapsed tick, plus a
+// higher-level slot every 64 ticks, never the whole timer set.
+const uint32_t WHEEL_TICK_MS = 100;
+const uint8_t WHEEL_BITS = 6;
+const uint8_t WHEEL_LEVELS = 4;
+const uint32_t WHEEL_SLOTS = 1UL<<WHEEL_BITS;
+const uint32_t WHEEL_MASK = WHEEL_SLOTS-1;
+const uint32_t WHEEL_SPAN = 1UL<<(WHEEL_BITS*WHEEL_LEVELS);   // ticks
+
+struct Timer {
+  typedef void (*Fn)(Timer &t);
+  Fn fn = nullptr;
+  uint8_t arg = 0;          // for the owner, e.g. the load index
+  uint32_t periodMs = 0;    // re-armed this long after each expiry, 0 = one-shot
+
+  bool armed() const { return pprev!=nullptr; }
+
+private:
+  friend class TimerWheel;
+  Timer *next = nullptr;
+  Timer **pprev = nullptr;  // the pointer that points at this timer
+  uint32_t expires = 0;     // wheel tick
+};
+
+class TimerWheel {
+public:
+  void begin(uint32_t nowMs);
+  // (Re)arms t to fire delayMs from the last advance(), rounded up to a tick.
+  void arm(Timer &t, uint32_t delayMs);
+  void cancel(Timer &t);
+  // Runs every timer due by nowMs; callbacks may arm and cancel freely.
+  // Returns the number fired.
+  uint32_t advance(uint32_t nowMs);
+  // Time left on an armed timer, 0 if not armed.
+  uint32_t remainingMs(const Timer &t) const;
+
+  uint16_t pending = 0;     // armed timers
+  uint32_t fired = 0;       // lifetime expiries
+  uint32_t cascaded = 0;    // timers moved down a level
+
+private:
+  void place(Timer &t);
+  static void detach(Timer &t);
+  void cascade(uint8_t level);
+
+  Timer *slots[WHEEL_LEVELS][WHEEL_SLOTS] = {};
+  uint32_t now = 0;         // next tick to run
+  uint32_t lastMs = 0;
+  uint32_t carryMs = 0;     // ms elapsed into the current tick
+};
+
+extern TimerWheel timers;
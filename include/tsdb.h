@@ -0,0 +1,163 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ---------------- Time-series store ----------------
+// Append-only history on SPIFFS. Each tier is a ring of fixed-size segment
+// files; when the newest segment is full the oldest one is recycled. Every
+// record is 16 bytes and carries its own CRC, so a torn tail after a power
+// cut is dropped on read instead of corrupting the tier.
+//
+// Tier  bucket  segments    retention (drops a whole segment at a time)
+// raw   1 s     4 x 32 KB   1.7 - 2.3 h
+// min   1 min   4 x 64 KB   2.1 - 2.8 days
+// hour  1 h     4 x 32 KB   64 - 85 days
+// day   1 day   2 x 16 KB   8 - 17 months
+//
+// ~540 KB of SPIFFS in total. One second of raw data for four loads is
+// 16 B, so raw retention is hours; the rollups carry the long history.
+//
+// Records are staged in a one-page RAM buffer per tier and written a page
+// at a time, so flash sees one 256 B append per 16 records. Hour and day
+// rollups are rare enough to be written as soon as their bucket closes.
+// The recorder also flushes every TS_FLUSH_MS, so a power cut loses at
+// most that much of the minute tier (raw fills a page every 16 s).
+//
+// The buckets still being filled are RAM only. At the first ingest after a
+// restart they are rebuilt from the next finer tier on flash (the minute
+// from raw records, the hour from minutes, the day from hours), and one left
+// open by the previous run is closed the same way. Raw records hold mean
+// power, so a minute rebuilt from them has approximate energy and peak.
+
+const uint8_t TS_LOADS = 4;
+const size_t TS_RECORD_LEN = 16;
+const size_t TS_PAGE_RECORDS = 16;
+const uint32_t TS_FLUSH_MS = 60000;
+
+enum Tier : uint8_t { TIER_RAW, TIER_MIN, TIER_HOUR, TIER_DAY, TIER_COUNT };
+
+struct TierSpec {
+  char prefix;         // segment files are /ts/<prefix><slot>
+  uint32_t bucketSec;
+  uint8_t segments;
+  uint32_t segBytes;
+  bool eager;          // flush on every bucket close, not only on a full page
+};
+extern const TierSpec TIERS[TIER_COUNT];
+
+// 1 s, all loads in one record.
+struct RawRecord {
+  uint32_t t;          // epoch s
+  uint16_t p[TS_LOADS];// mean power, 10 mW units
+  uint8_t relays;      // bit per load
+  uint8_t rsv;
+  uint16_t crc;        // CRC-16 over the first 14 bytes
+};
+
+// Minute / hour / day rollup, one record per load.
+struct RollRecord {
+  uint32_t t;          // bucket start, epoch s
+  uint32_t uWh;        // energy in the bucket
+  uint32_t onSec;      // relay-on seconds in the bucket
+  uint16_t pMax;       // highest window power, 10 mW units
+  uint8_t load;        // 0-based
+  uint8_t crc;         // CRC-8 over the first 15 bytes
+};
+
+static_assert(sizeof(RawRecord)==TS_RECORD_LEN && sizeof(RollRecord)==TS_RECORD_LEN, "record layout");
+
+// One second of one load, as handed to ingest().
+struct TsSample {
+  uint32_t uWh;        // energy since the previous ingest
+  uint32_t onSec;      // relay-on seconds since the previous ingest
+  float pMean, pMax;   // W
+  bool relay;
+};
+
+// Called once per record; return false to stop the scan.
+typedef bool (*TsVisitor)(Tier tier, const uint8_t* rec, void* ctx);
+
+class TsStore {
+public:
+  // Mounts existing segments. tzOffset aligns buckets to local time.
+  void begin(int32_t tzOffset);
+  // Records one second and rolls it into every coarser tier.
+  void ingest(uint32_t t, const TsSample* s);
+  // Writes all staged records out (e.g. before a planned restart).
+  void flush();
+
+  // Visits valid records of tier whose bucket overlaps [from, to), oldest
+  // first, including records still staged in RAM and, for rollups, the
+  // bucket still being filled. Returns the number visited.
+  size_t scan(Tier tier, uint32_t from, uint32_t to, TsVisitor fn, void* ctx);
+  // Coarsest tier whose bucket fits in step, so the fewest records answer
+  // the query; if that tier has already dropped from, the next coarser one
+  // that reaches further back.
+  Tier pickTier(uint32_t from, uint32_t step) const;
+  // Oldest time held by tier, 0 if empty.
+  uint32_t oldest(Tier tier) const;
+
+  uint32_t pageWrites = 0;    // page appends issued
+  uint32_t recordsDropped = 0;// failed writes
+
+private:
+  struct Seg { uint32_t seq = 0, t0 = 0; };
+  struct Roll { uint32_t t0 = 0; uint64_t uWh = 0; uint32_t onSec = 0; uint16_t pMax = 0; bool open = false; };
+
+  void stage(Tier tier, const uint8_t* rec);
+  void flushTier(Tier tier);
+  void closeBucket(Tier tier, uint8_t load);
+  void resume(uint32_t t);
+  void rebuild(Tier tier, uint32_t from, uint32_t to);
+  uint32_t newest(Tier tier) const;
+  uint32_t bucketStart(Tier tier, uint32_t t) const;
+
+  int32_t tz = 0;
+  Seg seg[TIER_COUNT][4];
+  uint8_t cur[TIER_COUNT] = {0};
+  uint32_t used[TIER_COUNT] = {0};     // bytes in the current segment, 0 = none yet
+  uint8_t page[TIER_COUNT][TS_PAGE_RECORDS*TS_RECORD_LEN];
+  uint8_t staged[TIER_COUNT] = {0};
+  Roll roll[TIER_COUNT][TS_LOADS];
+  bool resumed = false;                // open buckets rebuilt after begin()
+};
+
+// ---------------- Range aggregation ----------------
+// One output bucket of a range query, per load.
+struct TsBucket {
+  uint32_t t;                  // bucket start
+  uint64_t uWh[TS_LOADS];
+  uint32_t onSec[TS_LOADS];
+  uint16_t pMax[TS_LOADS];     // 10 mW units
+};
+
+// Folds records from scan() into fixed step buckets starting at from, in
+// constant memory: only the bucket being filled is held. A rollup that
+// straddles from is counted in the first bucket.
+class TsBucketer {
+public:
+  typedef void (*Emit)(const TsBucket& b, void* ctx);
+
+  void begin(uint32_t from, uint32_t step, Emit emit, void* ctx);
+  void add(Tier tier, const uint8_t* rec);
+  // Emits the last bucket, if it holds anything.
+  void finish();
+  // TsVisitor adapter; ctx is the TsBucketer.
+  static bool visit(Tier tier, const uint8_t* rec, void* ctx);
+
+  uint32_t emitted = 0;
+
+private:
+  uint32_t from = 0, step = 1;
+  Emit emit = nullptr;
+  void* ctx = nullptr;
+  TsBucket cur;
+  bool open = false;
+};
+
+// Power in 10 mW units, saturating.
+inline uint16_t tsPower(float w){
+  if(!(w>0)) return 0;
+  float u = w*100.0f + 0.5f;
+  return u>=65535.0f ? 65535 : (uint16_t)u;
+}
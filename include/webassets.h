@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ---------------- Static assets ----------------
+// scripts/build_web.py stages data/ into the filesystem image: text assets
+// gzipped, index.html's asset links versioned with ?v=<etag>, and a manifest
+// of strong ETags (one "<path> <etag>" line per file). At boot the manifest
+// becomes an in-RAM index of everything served (size, content type, ETag,
+// .gz variant), so routing a request costs a hash lookup and flash is only
+// touched to stream the body.
+
+const char* const ASSET_MANIFEST = "/etags.txt";
+const uint8_t ASSET_MAX = 16;
+const uint8_t ASSET_SLOTS = 32;               // power of two, >= 2x ASSET_MAX
+const uint8_t ASSET_PATH_LEN = 32;
+const uint8_t ETAG_LEN = 16;                  // hex digits
+
+struct Asset {
+  char path[ASSET_PATH_LEN];   // as requested, e.g. "/app.js"; "" = free slot
+  char etag[ETAG_LEN+1];
+  uint32_t size;               // bytes stored (compressed when gz)
+  uint8_t type;                // index into CONTENT_TYPES
+  bool gz;                     // stored as path + ".gz"
+};
+
+class AssetIndex {
+public:
+  // Reads the manifest and opens each listed file once for its variant and
+  // size; entries whose file is missing are left out. Returns the count.
+  uint8_t begin(const char* manifest);
+  const Asset* find(const char* path) const;
+  uint8_t size() const { return count; }
+
+private:
+  Asset slots[ASSET_SLOTS];
+  uint8_t count = 0;
+};
+
+extern AssetIndex assets;
+
+extern const char* const CONTENT_TYPES[];
+uint8_t contentTypeOf(const char* path);   // by extension; 0 = text/plain
+
+// True if an If-None-Match header value names etag (or is "*").
+bool etagMatches(const char* ifNoneMatch, const char* etag);
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry.h"
+#include "notiflog.h"
+
+// ---------------- WebSocket API ----------------
+// State broadcast, command dispatch and notifications for the dashboard.
+// Board independent: frames leave through the transport hooks below, which
+// main.cpp backs with WebSocketsServer (and the benchmarks with a sink).
+
+// WS clients, one bit per client slot
+extern uint32_t wsClients;       // connected
+extern uint32_t wsBinClients;    // opted in to the binary state frame
+extern uint32_t wsDeltaClients;  // opted in to changed-only updates
+extern uint32_t wsNeedKey;       // owed a full keyframe on the next tick
+extern uint32_t stateSeq;
+const uint16_t KEYFRAME_TICKS = 30;  // full state to everyone this often
+
+extern NotifLog notifLog;
+
+// JSON state frames: a static arena and output buffer reused every tick.
+// A full frame for four loads peaks near 1.5 KB of arena and 1.25 KB of text.
+const size_t STATE_JSON_CAPACITY = 2048;
+const size_t STATE_OUT_MAX = 2048;
+struct WsTxStats {
+  uint32_t maxPayload;   // largest JSON state frame sent, bytes
+  uint32_t maxArena;     // peak arena use, bytes
+  uint32_t truncated;    // frames dropped for not fitting the arena or buffer
+};
+extern WsTxStats wsTx;
+
+void wsConnected(uint8_t num);
+void wsDisconnected(uint8_t num);
+void wsCommand(uint8_t num, char* payload, size_t length);   // parses payload in place
+void broadcastState();
+
+// Transport
+void wsSendText(uint8_t num, const char* s, size_t n);
+void wsBroadcastText(const char* s, size_t n);
+void wsSendBin(uint8_t num, const uint8_t* b, size_t n);
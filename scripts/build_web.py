@@ -0,0 +1,125 @@
+# Stages data/ into the filesystem image directory (data_dir in
+# platformio.ini) before every esp32dev build / buildfs / uploadfs:
+#   - text assets are stored gzipped only (the file server adds
+#     Content-Encoding for .gz files)
+#   - local script / stylesheet links in index.html get ?v=<etag>, so the
+#     browser may cache those assets for good and still sees every change
+#   - etags.txt lists "<path> <etag>" per served file for src/webassets.cpp
+#   - the chart and PDF libraries in data/lib are staged under /lib, so the
+#     dashboard needs no internet access; each is checked against its pinned
+#     sha256 (VENDOR) on every build, and the build fails on a mismatch or
+#     on a file there without a pin
+#   - the build fails if a page plus the assets it links exceed PAGE_BUDGET
+#
+# Also runs standalone: python3 scripts/build_web.py [project_dir] [out_dir]
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import sys
+
+COMPRESS = (".html", ".js", ".css", ".json", ".svg", ".txt")
+ETAG_LEN = 16      # include/webassets.h
+PATH_MAX = 31      # ASSET_PATH_LEN - 1
+MANIFEST = "etags.txt"
+LOCAL_LINK = re.compile(r'((?:src|href)=")([^":?#]+\.(?:js|css))(")')
+PAGE_BUDGET = 256 * 1024   # bytes on the wire to open a page with a cold cache
+
+# data/lib/<name>: sha256, staged as /lib/<name>. chart-lite.js and
+# pdf-lite.js cover the part of the Chart.js 4 / jsPDF 2 APIs app.js uses;
+# to swap in an upstream build, check it against the release's own
+# checksums, put it in data/lib, point index.html at it and pin it here.
+VENDOR = {
+    "chart-lite.js": "453807cb17d66c608b77f9f6d5ac3ed74e935458bb519e72d47bef583425a0b8",
+    "pdf-lite.js": "e59e23dee625d17437afbb250dd765231e1fe7edadeb9ea8663a976daed4785f",
+}
+
+
+def etag(data):
+    return hashlib.sha256(data).hexdigest()[:ETAG_LEN]
+
+
+def read_vendor(lib):
+    names = os.listdir(lib) if os.path.isdir(lib) else []
+    for n in sorted(names):
+        if os.path.isfile(os.path.join(lib, n)) and n not in VENDOR:
+            raise SystemExit("build_web: lib/%s has no pinned sha256; verify it and pin it in VENDOR" % n)
+    libs = {}
+    for n, want in sorted(VENDOR.items()):
+        path = os.path.join(lib, n)
+        if not os.path.isfile(path):
+            raise SystemExit("build_web: %s is pinned but missing" % path)
+        with open(path, "rb") as f:
+            data = f.read()
+        got = hashlib.sha256(data).hexdigest()
+        if got != want:
+            raise SystemExit("build_web: lib/%s: sha256 %s does not match the pinned %s" % (n, got, want))
+        libs[n] = data
+    return libs
+
+
+def stage(src, out, libs):
+    if os.path.isdir(out):
+        shutil.rmtree(out)
+    os.makedirs(os.path.join(out, "lib"))
+    names = sorted(n for n in os.listdir(src) if os.path.isfile(os.path.join(src, n)))
+    tags = {}
+    stored = {}
+
+    def store(name, data):
+        path = "/" + name
+        if len(path) > PATH_MAX:
+            raise SystemExit("build_web: %s: name too long for the asset index" % name)
+        if name.endswith(COMPRESS):
+            # mtime=0 keeps the bytes, and so the ETag, reproducible
+            data = gzip.compress(data, 9, mtime=0)
+            name += ".gz"
+        with open(os.path.join(out, name), "wb") as f:
+            f.write(data)
+        tags[path] = etag(data)
+        stored[path] = len(data)
+
+    for n in sorted(libs):
+        store("lib/" + n, libs[n])
+
+    # Pages last: their links carry the other assets' ETags.
+    pages = [n for n in names if n.endswith(".html")]
+    for n in names:
+        if n not in pages:
+            with open(os.path.join(src, n), "rb") as f:
+                store(n, f.read())
+    for n in pages:
+        with open(os.path.join(src, n), encoding="utf-8") as f:
+            html = f.read()
+
+        def version(m):
+            tag = tags.get("/" + m.group(2).lstrip("./"))
+            return m.group(0) if tag is None else m.group(1) + m.group(2) + "?v=" + tag + m.group(3)
+
+        store(n, LOCAL_LINK.sub(version, html).encode("utf-8"))
+        linked = set("/" + m.group(2).lstrip("./") for m in LOCAL_LINK.finditer(html))
+        cost = stored["/" + n] + sum(stored.get(p, 0) for p in linked)
+        print("build_web: /%s loads %d bytes (budget %d)" % (n, cost, PAGE_BUDGET))
+        if cost > PAGE_BUDGET:
+            raise SystemExit("build_web: /%s is over its page-load budget" % n)
+
+    with open(os.path.join(out, MANIFEST), "w") as f:
+        for path in sorted(tags):
+            f.write("%s %s\n" % (path, tags[path]))
+    return stored
+
+
+def build(project, out):
+    src = os.path.join(project, "data")
+    stored = stage(src, out, read_vendor(os.path.join(src, "lib")))
+    print("build_web: %d assets, %d bytes" % (len(stored), sum(stored.values())))
+
+
+try:
+    Import("env")  # noqa: F821 (SCons)
+    build(env.subst("$PROJECT_DIR"), env.subst("$PROJECT_DATA_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        _project = sys.argv[1] if len(sys.argv) > 1 else "."
+        build(_project, sys.argv[2] if len(sys.argv) > 2 else os.path.join(_project, ".pio", "www"))
@@ -0,0 +1,326 @@
+// Host microbenchmarks for the per-tick hot paths, with a stored baseline.
+//
+//   pio run -e bench && .pio/build/bench/program [options]
+//     --baseline <file>  compare against (default src/bench/baseline.json)
+//     --write            record this run as the new baseline
+//     --filter <text>    only cases whose name contains text
+//     --min-time <s>     timing pass length per case (default 0.3)
+//     --ns-tol <f>       allowed slow-down, 0.5 = 50% (default; timing is
+//                        noisy, allocation counts are compared exactly)
+//
+// Exit status 1 if any case regressed past the baseline or has none; a new
+// case is recorded with --write --filter <name>. An entry without "ns" (not
+// yet timed on the reference host) is held to its allocation figures only.
+//
+// Cases that go through ArduinoJson depend on its pool and String handling,
+// so their entries carry the library version they were recorded with and
+// only count against a build of that version (the pinned one in
+// platformio.ini); anything else fails as STALE until re-recorded.
+#include <SPIFFS.h>
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include "heap.h"
+#include "hal.h"
+#include "../sim/sim.h"
+#include "sampler.h"
+#include "control.h"
+#include "settings.h"
+#include "telemetry.h"
+#include "wsapi.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const char* DEFAULT_BASELINE = "src/bench/baseline.json";
+const uint32_t WARMUP_OPS = 200;
+const uint32_t COUNT_OPS = 3000;   // allocation pass; a multiple of KEYFRAME_TICKS keeps delta counts steady
+const uint32_t BATCH = 64;         // ops between clock reads in the timing pass
+const uint32_t TIMING_RUNS = 5;
+const double NS_SLACK = 25;        // sub-100 ns cases jitter by more than any sane ratio
+
+// ---------------- Transport sink ----------------
+volatile size_t sinkBytes = 0;
+void wsSendText(uint8_t, const char*, size_t n){ sinkBytes += n; }
+void wsBroadcastText(const char*, size_t n){ sinkBytes += n; }
+void wsSendBin(uint8_t, const uint8_t*, size_t n){ sinkBytes += n; }
+
+// ---------------- Cases ----------------
+static Channel benchChannel;
+static uint32_t benchUs = 0;
+static uint32_t benchTick = 0;
+
+static Stat stat(float lo, float hi, float mean){
+  Stat s; s.min=lo; s.max=hi; s.mean=mean; s.rms=mean;
+  return s;
+}
+
+// A reading that moves a little every call, so delta updates have work.
+static void publishReadings(){
+  Readings s;
+  benchTick++;
+  for(int i=0;i<NUM_LOADS;i++){
+    Reading &r = s.r[i];
+    float p = 6.0f*(i+1) + (benchTick%7)*0.1f;
+    r.w.v = stat(11.9f, 12.1f, 12.0f);
+    r.w.i = stat(p/12.1f, p/11.9f, p/12);
+    r.w.p = stat(p-0.2f, p+0.2f, p);
+    r.w.n = 50;
+    r.uWh = (int64_t)benchTick*1667*(i+1);
+    r.costMilli = r.uWh*8/1000000;
+    r.onSecondsToday = benchTick;
+  }
+  readings.publish(s);
+}
+
+static void opChannelAdd(){
+  benchUs += 20000;
+  benchChannel.add(benchUs, 12.0f, 0.5f+(benchUs>>14&7)*0.01f, 8000);
+}
+
+static void setupSampler(){
+  for(int i=0;i<NUM_LOADS;i++){ sim::setLoad(i, 12.0f, 0.5f*(i+1), 0.05f); hal::setRelay(i, true); L[i].relay = true; }
+}
+static void opSamplerSample(){
+  sim::advance(20000);
+  sampler.sample();
+}
+
+static void opFrameEncode(){
+  static LoadState ls[NUM_LOADS];
+  static uint8_t frame[FRAME_HEADER_LEN+NUM_LOADS*FRAME_LOAD_LEN];
+  ls[0].r.uWh++;
+  sinkBytes += encodeStateFrame(frame, sizeof(frame), benchTick++, 8000, 50, ls, NUM_LOADS);
+}
+
+static void clients(uint32_t bin, uint32_t delta){
+  wsClients = 1; wsBinClients = bin; wsDeltaClients = delta; wsNeedKey = 0;
+}
+static void setupBroadcastJson(){ clients(0,0); }
+static void setupBroadcastBin(){ clients(1,0); }
+static void setupBroadcastDelta(){ clients(1,1); }
+static void setupBroadcastDeltaJson(){ clients(0,1); }
+static void opBroadcast(){
+  publishReadings();
+  broadcastState();
+}
+
+static void setupCommands(){ clients(0,0); }
+// The WebSockets library hands over a fresh writable buffer per message;
+// commands are parsed in place, so each op sends a new copy.
+static void sendCommand(const char* msg){
+  static char buf[128];
+  size_t n = strlen(msg);
+  memcpy(buf, msg, n+1);
+  wsCommand(0, buf, n);
+}
+static void opWsSetPrice(){ sendCommand("{\"cmd\":\"setPrice\",\"price\":8.5}"); }
+static void opWsSetLimits(){ sendCommand("{\"cmd\":\"setLimits\",\"seconds\":[43200,43200,3600,600]}"); }
+static void opWsRelay(){
+  static bool on = false;
+  on = !on;
+  sendCommand(on ? "{\"cmd\":\"relay\",\"id\":4,\"state\":true}" : "{\"cmd\":\"relay\",\"id\":4,\"state\":false}");
+}
+
+static void opPushNotification(){ pushNotification("Relay 2 auto OFF by limit"); }
+// The document is a StaticJsonDocument on the stack; what allocates is
+// opening the file: the sim's path string and fopen() here, a VFS handle
+// and stdio buffer on the board.
+static void opSaveSettings(){ saveSettingsToFS(); }
+
+struct Case {
+  const char* name;
+  void (*setup)();
+  void (*op)();
+  bool json;            // runs through ArduinoJson
+};
+
+const Case CASES[] = {
+  {"channel_add",          nullptr,                 opChannelAdd,       false},
+  {"sampler_sample",       setupSampler,            opSamplerSample,    false},
+  {"frame_encode",         nullptr,                 opFrameEncode,      false},
+  {"broadcast_json",       setupBroadcastJson,      opBroadcast,        true},
+  {"broadcast_json_delta", setupBroadcastDeltaJson, opBroadcast,        true},
+  {"broadcast_bin",        setupBroadcastBin,       opBroadcast,        false},
+  {"broadcast_bin_delta",  setupBroadcastDelta,     opBroadcast,        false},
+  {"ws_set_price",         setupCommands,           opWsSetPrice,       true},
+  {"ws_set_limits",        setupCommands,           opWsSetLimits,      true},
+  {"ws_relay",             setupCommands,           opWsRelay,          true},
+  {"push_notification",    setupCommands,           opPushNotification, true},
+  {"save_settings",        nullptr,                 opSaveSettings,     true},
+};
+const size_t NUM_CASES = sizeof(CASES)/sizeof(CASES[0]);
+
+// ---------------- Runner ----------------
+struct Result {
+  double ns = 0;
+  double allocs = 0;   // per op
+  double bytes = 0;    // allocated per op
+  double peak = 0;     // largest live-heap rise within one op
+  char lib[16] = "";   // ArduinoJson version, json cases only
+  bool have = false;
+};
+
+static Result measure(const Case &c, double minTime){
+  Result r;
+  if(c.setup) c.setup();
+  for(uint32_t k=0;k<WARMUP_OPS;k++) c.op();
+
+  // Allocation pass: per-op peak needs a reset around every op.
+  uint64_t a0 = heap.allocs, b0 = heap.bytes;
+  int64_t worst = 0;
+  for(uint32_t k=0;k<COUNT_OPS;k++){
+    int64_t base = heap.live;
+    heap.peak = base;
+    c.op();
+    if(heap.peak-base > worst) worst = heap.peak-base;
+  }
+  r.allocs = double(heap.allocs-a0)/COUNT_OPS;
+  r.bytes = double(heap.bytes-b0)/COUNT_OPS;
+  r.peak = (double)worst;
+
+  // Timing pass, untouched by the bookkeeping above; best of a few runs so
+  // a scheduler hiccup does not count as a regression.
+  r.ns = 1e30;
+  for(uint32_t run=0;run<TIMING_RUNS;run++){
+    uint64_t ops = 0;
+    Clock::time_point t0 = Clock::now();
+    double elapsed;
+    do {
+      for(uint32_t k=0;k<BATCH;k++) c.op();
+      ops += BATCH;
+      elapsed = std::chrono::duration<double>(Clock::now()-t0).count();
+    } while(elapsed < minTime/TIMING_RUNS);
+    if(elapsed*1e9/ops < r.ns) r.ns = elapsed*1e9/ops;
+  }
+  if(c.json) snprintf(r.lib, sizeof(r.lib), "%s", ARDUINOJSON_VERSION);
+  r.have = true;
+  return r;
+}
+
+static bool readFile(const char* path, std::string &out){
+  FILE* f = fopen(path, "rb");
+  if(!f) return false;
+  char buf[1024];
+  size_t n;
+  while((n = fread(buf,1,sizeof(buf),f))>0) out.append(buf,n);
+  fclose(f);
+  return true;
+}
+
+static bool loadBaseline(const char* path, Result* base){
+  std::string text;
+  if(!readFile(path, text)) return false;
+  DynamicJsonDocument doc(8192);
+  if(deserializeJson(doc, text.c_str(), text.size())){ fprintf(stderr,"%s: parse error\n",path); return false; }
+  for(size_t k=0;k<NUM_CASES;k++){
+    JsonVariant c = doc["cases"][CASES[k].name];
+    if(c.isNull()) continue;
+    base[k].ns = c["ns"] | 0.0;
+    base[k].allocs = c["allocs"] | 0.0;
+    base[k].bytes = c["bytes"] | 0.0;
+    base[k].peak = c["peak"] | 0.0;
+    snprintf(base[k].lib, sizeof(base[k].lib), "%s", c["arduinojson"] | "");
+    base[k].have = true;
+  }
+  return true;
+}
+
+static bool writeBaseline(const char* path, const Result* res, const Result* old){
+  DynamicJsonDocument doc(8192);
+  doc["note"] = "ns/op are host-specific; allocs, bytes and peak are per op";
+  JsonObject cases = doc.createNestedObject("cases");
+  for(size_t k=0;k<NUM_CASES;k++){
+    const Result &r = res[k].have ? res[k] : old[k];   // keep cases filtered out of this run
+    if(!r.have) continue;
+    JsonObject c = cases.createNestedObject(CASES[k].name);
+    c["ns"] = (int64_t)(r.ns*10+0.5)/10.0;
+    c["allocs"] = r.allocs;
+    c["bytes"] = r.bytes;
+    c["peak"] = r.peak;
+    if(CASES[k].json) c["arduinojson"] = r.lib;
+  }
+  String out;
+  serializeJsonPretty(doc, out);
+  FILE* f = fopen(path, "wb");
+  if(!f) return false;
+  fwrite(out.c_str(), 1, out.length(), f);
+  fputc('\n', f);
+  return fclose(f)==0;
+}
+
+// Allocation figures are exact for a given build, so any growth counts; the
+// small slack absorbs allocator rounding differences between hosts.
+static bool regressed(const char* name, const char* what, double was, double now, double rel, double slack){
+  if(now <= was*(1+rel)+slack) return false;
+  fprintf(stderr, "REGRESSION %s %s: %.2f -> %.2f\n", name, what, was, now);
+  return true;
+}
+
+int main(int argc, char** argv){
+  const char* baseline = DEFAULT_BASELINE;
+  const char* filter = nullptr;
+  bool write = false;
+  double minTime = 0.3, nsTol = 0.5;
+  for(int k=1;k<argc;k++){
+    const char* a = argv[k];
+    const char* v = k+1<argc ? argv[k+1] : nullptr;
+    if(!strcmp(a,"--write")) write = true;
+    else if(!strcmp(a,"--baseline") && v){ baseline = v; k++; }
+    else if(!strcmp(a,"--filter") && v){ filter = v; k++; }
+    else if(!strcmp(a,"--min-time") && v){ minTime = atof(v); k++; }
+    else if(!strcmp(a,"--ns-tol") && v){ nsTol = atof(v); k++; }
+    else { fprintf(stderr,"bad argument: %s\n",a); return 2; }
+  }
+
+  // Board state the cases run against: simulated board, scratch FS root.
+  setenv("SIM_FS", ".benchfs", 0);
+  if(!SPIFFS.begin(true)) hal::logf("FS root unavailable");
+  sim::setEpoch(sim::DEFAULT_EPOCH);
+  hal::initRelays();
+  sampler.begin();
+  if(!notifLog.begin("/notifs.log")) hal::logf("Notification log unavailable");
+  sim::setLogging(false);   // every notification would print
+  if(!heapSeesMalloc) printf("note: malloc is not hooked on this host; only operator new is counted\n");
+
+  Result base[NUM_CASES], res[NUM_CASES];
+  bool haveBase = loadBaseline(baseline, base);
+  if(!haveBase && !write) fprintf(stderr,"no baseline at %s; run with --write to record one\n", baseline);
+
+  printf("%-22s %10s %9s %9s %9s   %s\n", "case", "ns/op", "allocs", "bytes", "peak", "vs baseline");
+  bool bad = false;
+  for(size_t k=0;k<NUM_CASES;k++){
+    const Case &c = CASES[k];
+    if(filter && !strstr(c.name, filter)) continue;
+    Result &r = res[k] = measure(c, minTime);
+    printf("%-22s %10.1f %9.2f %9.1f %9.0f", c.name, r.ns, r.allocs, r.bytes, r.peak);
+    if(base[k].have && base[k].ns>0) printf("   %+6.1f%% ns", (r.ns/base[k].ns-1)*100);
+    printf("\n");
+    if(write) continue;
+    if(!base[k].have){
+      fprintf(stderr, "MISSING %s: no baseline entry\n", c.name);
+      bad = true;
+      continue;
+    }
+    if(c.json && strcmp(base[k].lib, ARDUINOJSON_VERSION)){
+      fprintf(stderr, "STALE %s: recorded against ArduinoJson \"%s\", this build has %s\n",
+              c.name, base[k].lib, ARDUINOJSON_VERSION);
+      bad = true;
+      continue;
+    }
+    if(base[k].ns>0) bad |= regressed(c.name, "ns/op", base[k].ns, r.ns, nsTol, NS_SLACK);
+    bad |= regressed(c.name, "allocs/op", base[k].allocs, r.allocs, 0, 0.01);
+    bad |= regressed(c.name, "bytes/op", base[k].bytes, r.bytes, 0.05, 16);
+    bad |= regressed(c.name, "peak", base[k].peak, r.peak, 0.05, 16);
+  }
+
+  if(write){
+    if(!writeBaseline(baseline, res, base)){ fprintf(stderr,"cannot write %s\n",baseline); return 1; }
+    printf("baseline written to %s\n", baseline);
+    return 0;
+  }
+  if(bad) fprintf(stderr, "benchmarks failed against %s\n", baseline);
+  return bad ? 1 : 0;
+}
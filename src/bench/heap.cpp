@@ -0,0 +1,71 @@
+#include "heap.h"
+#include <new>
+#include <stdlib.h>
+
+HeapStats heap;
+
+static inline void counted(size_t n){
+  heap.allocs++;
+  heap.bytes += n;
+  heap.live += n;
+  if(heap.live>heap.peak) heap.peak = heap.live;
+}
+
+#if defined(__GLIBC__)
+// glibc: wrap the malloc family itself, so C and C++ allocations are both seen.
+#include <malloc.h>
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t n){
+  void* p = __libc_malloc(n);
+  if(p) counted(malloc_usable_size(p));
+  return p;
+}
+void* calloc(size_t k, size_t n){
+  void* p = __libc_calloc(k, n);
+  if(p) counted(malloc_usable_size(p));
+  return p;
+}
+void* realloc(void* old, size_t n){
+  size_t was = old ? malloc_usable_size(old) : 0;
+  void* p = __libc_realloc(old, n);
+  if(!p) return p;
+  heap.live -= was;
+  counted(malloc_usable_size(p));
+  return p;
+}
+void free(void* p){
+  if(!p) return;
+  heap.live -= malloc_usable_size(p);
+  __libc_free(p);
+}
+}
+const bool heapSeesMalloc = true;
+
+#else
+// Elsewhere: operator new only, with the size kept in a header.
+struct alignas(alignof(max_align_t)) Header { size_t n; };
+
+void* operator new(size_t n){
+  Header* h = (Header*)::malloc(sizeof(Header)+n);
+  if(!h) throw std::bad_alloc();
+  h->n = n;
+  counted(n);
+  return h+1;
+}
+void operator delete(void* p) noexcept {
+  if(!p) return;
+  Header* h = (Header*)p-1;
+  heap.live -= h->n;
+  ::free(h);
+}
+void* operator new[](size_t n){ return operator new(n); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+const bool heapSeesMalloc = false;
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------- Heap accounting ----------------
+// Every allocation in the bench process passes through heap.cpp, which keeps
+// these counters. Sizes are as the allocator reports them (usable size), so
+// they include its rounding.
+struct HeapStats {
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+  int64_t live = 0;
+  int64_t peak = 0;
+};
+
+extern HeapStats heap;
+// false where malloc() cannot be hooked; then only operator new is counted,
+// which misses ArduinoJson's pools.
+extern const bool heapSeesMalloc;
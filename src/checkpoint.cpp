@@ -0,0 +1,113 @@
+#include "checkpoint.h"
+#include "crc.h"
+#include "hal.h"
+#include <SPIFFS.h>
+#include <string.h>
+
+static const size_t RING_BYTES = (size_t)CKPT_SLOTS*sizeof(CheckpointRec);
+static_assert(RING_BYTES%256==0, "format() writes 256 B blocks");
+static_assert(sizeof(CheckpointRec)<=hal::RTC_BYTES, "RTC copy must fit");
+
+Checkpoints checkpoints;
+volatile uint16_t checkpointSec = CKPT_SEC_DEFAULT;
+
+static bool recValid(const CheckpointRec& r){
+  return r.seq && r.magic==CKPT_MAGIC && crc16((const uint8_t*)&r,238)==r.crc;
+}
+
+static void seal(CheckpointRec& r){
+  r.magic = CKPT_MAGIC;
+  r.crc = crc16((const uint8_t*)&r,238);
+}
+
+// Writes RING_BYTES of empty slots. Only at first boot or after corruption.
+bool Checkpoints::format(){
+  if(f) f.close();
+  f = SPIFFS.open(path, FILE_WRITE);
+  if(!f) return false;
+  uint8_t zero[256];
+  memset(zero,0,sizeof(zero));
+  for(size_t o=0;o<RING_BYTES;o+=sizeof(zero)) f.write(zero,sizeof(zero));
+  f.close();
+  f = SPIFFS.open(path, "r+");
+  return (bool)f;
+}
+
+bool Checkpoints::begin(const char* p){
+  path = p;
+  memset(&rec,0,sizeof(rec));
+  memset(&flashRec,0,sizeof(flashRec));
+  nextSlot = 0;
+  if(!SPIFFS.exists(path)) return format();
+  f = SPIFFS.open(path, "r+");
+  if(!f || f.size()!=RING_BYTES) return format();
+
+  CheckpointRec r;
+  for(uint16_t k=0;k<CKPT_SLOTS;k++){
+    if(f.read((uint8_t*)&r,sizeof(r))!=sizeof(r)) break;
+    if(!recValid(r) || r.seq<=flashRec.seq) continue;
+    flashRec = r;
+    nextSlot = (k+1) % CKPT_SLOTS;
+  }
+  rec = flashRec;
+  return true;
+}
+
+const char* Checkpoints::restore(){
+  const char* from = nullptr;
+  if(flashRec.seq) from = "flash";
+  CheckpointRec r;
+  if(hal::rtcLoad(&r,sizeof(r)) && recValid(r) && r.seq>rec.seq){ rec = r; from = "rtc"; }
+  if(!from) return nullptr;
+  Readings saved;
+  saved.day = rec.day;
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    Reading &r = saved.r[i];
+    r.uWh = rec.uWh[i]; r.costMilli = rec.costMilli[i];
+    r.uWhToday = rec.uWhToday[i]; r.costToday = rec.costToday[i];
+    r.onSecondsToday = rec.onSec[i];
+  }
+  sampler.restore(saved);
+  DemandPeak today[DEMAND_CHANNELS], month[DEMAND_CHANNELS];
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+    today[c].mW = rec.dayPeakMw[c]; today[c].at = rec.dayPeakAt[c];
+    month[c].mW = rec.monthPeakMw[c]; month[c].at = rec.monthPeakAt[c];
+  }
+  demand.restore(rec.day, today, month);
+  lastWriteMs = hal::millis();
+  return from;
+}
+
+void Checkpoints::fill(uint32_t epoch, const Readings &s){
+  rec.seq++;
+  rec.epoch = epoch;
+  rec.day = s.day;
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    rec.onSec[i] = s.r[i].onSecondsToday;
+    rec.uWh[i] = s.r[i].uWh;
+    rec.costMilli[i] = s.r[i].costMilli;
+    rec.uWhToday[i] = s.r[i].uWhToday;
+    rec.costToday[i] = s.r[i].costToday;
+  }
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+    rec.dayPeakMw[c] = demand.today[c].mW; rec.dayPeakAt[c] = demand.today[c].at;
+    rec.monthPeakMw[c] = demand.month[c].mW; rec.monthPeakAt[c] = demand.month[c].at;
+  }
+  seal(rec);
+}
+
+void Checkpoints::tick(uint32_t epoch, const Readings &s){
+  fill(epoch, s);
+  hal::rtcStore(&rec, sizeof(rec));
+
+  uint32_t now = hal::millis();
+  if(now-lastWriteMs < (uint32_t)checkpointSec*1000) return;
+  lastWriteMs = now;
+  if(f && f.seek(nextSlot*sizeof(CheckpointRec))){
+    f.write((const uint8_t*)&rec, sizeof(rec));
+    f.flush();
+    flashRec = rec;
+    nextSlot = (nextSlot+1) % CKPT_SLOTS;
+    writes++;
+  }
+}
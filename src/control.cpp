@@ -0,0 +1,171 @@
+#include "control.h"
+#include "hal.h"
+#include <stdio.h>
+
+Load L[NUM_LOADS];
+volatile uint32_t demandLimitW = 0;
+static bool scheduleArmed = false;   // daily timers aimed at the wall clock
+
+static void notify(uint8_t i, const char* what, const char* why){
+  char msg[48];
+  snprintf(msg,sizeof(msg),"Relay %d %s by %s",i+1,what,why);
+  pushNotification(msg);
+}
+
+// Arms the cutoff for the usage still left today. The sampler counts on-time
+// in whole windows, so the timer may fire a little early; it then re-arms for
+// the rest. It also re-arms after midnight, when onSecondsToday restarts.
+static void armLimit(uint8_t i){
+  Load &l = L[i];
+  timers.cancel(l.limitTimer);
+  if(!l.relay || l.usageLimitSeconds==0) return;
+  uint32_t used = readings.read().r[i].onSecondsToday;
+  uint32_t left = used>=l.usageLimitSeconds ? 0 : l.usageLimitSeconds-used;
+  timers.arm(l.limitTimer, left*1000);
+}
+
+static void switchRelay(uint8_t i, bool on, uint32_t epoch){
+  Load &l = L[i];
+  hal::setRelay(i,on);
+  l.relay = on;
+  if(on && l.timerMinutes>0){
+    timers.arm(l.offTimer, (uint32_t)l.timerMinutes*60000);
+    l.timerEndEpoch = epoch+l.timerMinutes*60;
+  } else {
+    timers.cancel(l.offTimer);
+    l.timerEndEpoch = 0;
+  }
+  armLimit(i);
+}
+
+static void autoOff(uint8_t i, const char* why){
+  switchRelay(i, false, 0);
+  notify(i, "auto OFF", why);
+}
+
+// Seconds from epoch to the next local secOfDay, never less than a minute so
+// a schedule that fires a moment early does not fire twice.
+static uint32_t untilLocal(int32_t secOfDay, uint32_t epoch){
+  uint32_t now = (epoch+sampler.tzOffset)%86400;
+  uint32_t d = (secOfDay+86400-now)%86400;
+  return d<60 ? d+86400 : d;
+}
+
+static void armSchedule(uint8_t i, uint32_t epoch){
+  Load &l = L[i];
+  timers.cancel(l.schedOn);
+  timers.cancel(l.schedOff);
+  if(epoch<EPOCH_VALID) return;
+  if(l.onAt>=0) timers.arm(l.schedOn, untilLocal(l.onAt,epoch)*1000);
+  if(l.offAt>=0) timers.arm(l.schedOff, untilLocal(l.offAt,epoch)*1000);
+}
+
+// ---------------- Timer callbacks ----------------
+static void onAutoOff(Timer &t){ autoOff(t.arg, "timer"); }
+
+static void onLimit(Timer &t){
+  uint8_t i = t.arg;
+  if(readings.read().r[i].onSecondsToday >= L[i].usageLimitSeconds) autoOff(i, "limit");
+  else armLimit(i);
+}
+
+static void onDelayedOn(Timer &t){
+  uint8_t i = t.arg;
+  if(L[i].relay) return;
+  switchRelay(i, true, hal::epoch());
+  notify(i, "ON", "delay");
+}
+
+// Daily: re-aimed at the wall clock on every firing, so millis() drift does
+// not accumulate.
+static void onSchedule(Timer &t){
+  uint8_t i = t.arg;
+  Load &l = L[i];
+  uint32_t epoch = hal::epoch();
+  bool on = &t==&l.schedOn;
+  timers.arm(t, untilLocal(on ? l.onAt : l.offAt, epoch)*1000);
+  if(on==l.relay) return;
+  if(on){ switchRelay(i, true, epoch); notify(i, "ON", "schedule"); }
+  else autoOff(i, "schedule");
+}
+
+void controlBegin(){
+  timers.begin(hal::millis());
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    Load &l = L[i];
+    l.offTimer.fn = onAutoOff;   l.offTimer.arg = i;
+    l.onTimer.fn = onDelayedOn;  l.onTimer.arg = i;
+    l.limitTimer.fn = onLimit;   l.limitTimer.arg = i;
+    l.schedOn.fn = onSchedule;   l.schedOn.arg = i;
+    l.schedOff.fn = onSchedule;  l.schedOff.arg = i;
+  }
+}
+
+void relayCommand(uint8_t i, bool on, uint32_t epoch){
+  timers.cancel(L[i].onTimer);
+  switchRelay(i, on, epoch);
+  char msg[24];
+  snprintf(msg,sizeof(msg),"Relay %d %s",i+1,on?"ON":"OFF");
+  pushNotification(msg);
+}
+
+void setTimer(uint8_t i, int minutes, uint32_t epoch){
+  Load &l = L[i];
+  l.timerMinutes = minutes;
+  if(l.relay && minutes>0){
+    timers.arm(l.offTimer, (uint32_t)minutes*60000);
+    l.timerEndEpoch = epoch+minutes*60;
+  } else {
+    timers.cancel(l.offTimer);
+    l.timerEndEpoch = 0;
+  }
+}
+
+void setLimit(uint8_t i, unsigned long seconds){
+  L[i].usageLimitSeconds = seconds;
+  armLimit(i);
+}
+
+void delayOn(uint8_t i, int minutes){
+  if(minutes>0) timers.arm(L[i].onTimer, (uint32_t)minutes*60000);
+  else timers.cancel(L[i].onTimer);
+}
+
+void setSchedule(uint8_t i, int32_t onAt, int32_t offAt){
+  L[i].onAt = onAt>=0 && onAt<86400 ? onAt : -1;
+  L[i].offAt = offAt>=0 && offAt<86400 ? offAt : -1;
+  if(scheduleArmed) armSchedule(i, hal::epoch());
+}
+
+void controlTick(uint32_t epoch){
+  if(scheduleArmed || epoch<EPOCH_VALID) return;
+  for(uint8_t i=0;i<NUM_LOADS;i++) armSchedule(i, epoch);
+  scheduleArmed = true;
+}
+
+void demandControl(const DemandMeter &d){
+  static bool warned = false;
+  uint32_t limit = demandLimitW*1000;
+  if(!limit) return;
+  uint32_t now = d.demandMw[DEMAND_TOTAL];
+  char msg[64];
+  if(now>=limit && d.lastMw[DEMAND_TOTAL]>=limit){
+    int8_t pick = -1;
+    for(uint8_t i=0;i<NUM_LOADS;i++)
+      if(L[i].relay && L[i].shed && (pick<0 || L[i].shed>L[pick].shed)) pick = i;
+    if(pick>=0){ autoOff(pick, "demand limit"); return; }
+  }
+  if(now>=limit*9/10 && !warned){
+    snprintf(msg,sizeof(msg),"Demand %lu W, %lu%% of the %lu W limit",(unsigned long)(now/1000),
+             (unsigned long)((uint64_t)now*100/limit),(unsigned long)demandLimitW);
+    pushNotification(msg);
+    warned = true;
+  } else if(now<limit*8/10) warned = false;
+}
+
+void shiftTimers(int32_t step){
+  for(uint8_t i=0;i<NUM_LOADS;i++)
+    if(L[i].timerEndEpoch>0) L[i].timerEndEpoch += step;
+  if(scheduleArmed)
+    for(uint8_t i=0;i<NUM_LOADS;i++) armSchedule(i, hal::epoch());
+}
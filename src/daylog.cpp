@@ -0,0 +1,65 @@
+#include "daylog.h"
+#include "crc.h"
+#include <SPIFFS.h>
+#include <string.h>
+
+static const size_t LOG_BYTES = (size_t)DAY_SLOTS*sizeof(DayRecord);
+static_assert(LOG_BYTES%256==0, "format() writes 256 B blocks");
+
+static bool recValid(const DayRecord& r){
+  return r.day && crc16((const uint8_t*)&r,126)==r.crc;
+}
+
+static void seal(DayRecord& r){
+  r.crc = crc16((const uint8_t*)&r,126);
+}
+
+static void blank(DayRecord& r){
+  memset(&r,0,sizeof(r));
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++) r.peakMin[c] = DEMAND_NO_MINUTE;
+}
+
+bool DayLog::format(){
+  if(f) f.close();
+  f = SPIFFS.open(path, FILE_WRITE);
+  if(!f) return false;
+  uint8_t zero[256];
+  memset(zero,0,sizeof(zero));
+  for(size_t o=0;o<LOG_BYTES;o+=sizeof(zero)) f.write(zero,sizeof(zero));
+  f.close();
+  f = SPIFFS.open(path, "r+");
+  return (bool)f;
+}
+
+bool DayLog::begin(const char* p){
+  path = p;
+  if(!SPIFFS.exists(path)) return format();
+  f = SPIFFS.open(path, "r+");
+  if(!f || f.size()!=LOG_BYTES) return format();
+  return true;
+}
+
+bool DayLog::write(const DayTotals &d, const DemandDay *peaks){
+  DayRecord r;
+  blank(r);
+  r.day = d.day;
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    r.onSec[i] = d.onSec[i];
+    r.uWh[i] = d.uWh[i];
+    r.costMilli[i] = d.costMilli[i];
+  }
+  if(peaks)
+    for(uint8_t c=0;c<DEMAND_CHANNELS;c++){ r.peakMw[c] = peaks->mW[c]; r.peakMin[c] = peaks->minute[c]; }
+  seal(r);
+  if(!f || !f.seek((d.day % DAY_SLOTS)*sizeof(DayRecord))) return false;
+  if(f.write((const uint8_t*)&r,sizeof(r))!=sizeof(r)) return false;
+  f.flush();
+  writes++;
+  return true;
+}
+
+bool DayLog::read(uint16_t day, DayRecord &out){
+  if(!f || !f.seek((day % DAY_SLOTS)*sizeof(DayRecord))) return false;
+  if(f.read((uint8_t*)&out,sizeof(out))!=sizeof(out)) return false;
+  return recValid(out) && out.day==day;
+}
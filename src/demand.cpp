@@ -0,0 +1,103 @@
+#include "demand.h"
+#include "recorder.h"
+#include "hal.h"
+
+DemandMeter demand;
+volatile uint8_t demandWindowMin = DEMAND_WINDOW_DEFAULT;
+
+static inline uint32_t toMw(uint64_t uWh, uint8_t minutes){
+  return minutes ? (uint32_t)(uWh*60/(minutes*1000ULL)) : 0;
+}
+
+// Only on a window change: sums the newest buckets that fit the new window.
+void DemandMeter::resum(){
+  uint8_t n = filled<window ? filled : window;
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+    sum[c] = 0;
+    for(uint8_t k=1;k<=n;k++) sum[c] += bucket[c][(head+DEMAND_BUCKETS-k)%DEMAND_BUCKETS];
+  }
+}
+
+void DemandMeter::closeBucket(uint32_t tnow){
+  uint8_t out = (head+DEMAND_BUCKETS-window)%DEMAND_BUCKETS;  // leaves the window
+  bool drop = filled>=window;
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+    if(drop) sum[c] -= bucket[c][out];
+    bucket[c][head] = cur[c];
+    sum[c] += cur[c];
+    lastMw[c] = toMw(cur[c],1);
+    cur[c] = 0;
+  }
+  head = (head+1)%DEMAND_BUCKETS;
+  if(filled<DEMAND_BUCKETS) filled++;
+
+  uint8_t span = filled<window ? filled : window;
+  uint32_t at = tnow>=EPOCH_VALID ? tnow : 0;
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+    uint32_t d = demandMw[c] = toMw(sum[c],span);
+    if(!full()) continue;
+    if(d>today[c].mW){ today[c].mW = d; today[c].at = at; }
+    if(d>month[c].mW){ month[c].mW = d; month[c].at = at; }
+  }
+}
+
+// Closes out the previous day's peaks. On the first day seen after a boot
+// with nothing restored, the month's peaks so far are read back from the
+// ledger instead.
+void DemandMeter::newDay(uint16_t d){
+  int32_t tz = sampler.tzOffset;
+  if(day){
+    closed.day = day;
+    for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+      closed.mW[c] = today[c].mW;
+      closed.minute[c] = today[c].at ? (today[c].at+tz)%86400/60 : DEMAND_NO_MINUTE;
+    }
+  }
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++) today[c] = DemandPeak();
+  uint16_t m = monthOfDay(d);
+  if(!day){
+    DayRecord r;
+    for(uint16_t dd=d-1; dd && monthOfDay(dd)==m; dd--){
+      if(!days.read(dd,r)) continue;
+      for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+        if(r.peakMw[c]<=month[c].mW) continue;
+        month[c].mW = r.peakMw[c];
+        month[c].at = r.peakMin[c]==DEMAND_NO_MINUTE ? 0 : (uint32_t)dd*86400 - tz + r.peakMin[c]*60;
+      }
+    }
+  } else if(m!=monthNo){
+    for(uint8_t c=0;c<DEMAND_CHANNELS;c++) month[c] = DemandPeak();
+  }
+  day = d;
+  monthNo = m;
+}
+
+void DemandMeter::restore(uint16_t d, const DemandPeak* t, const DemandPeak* m){
+  if(!d) return;
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++){ today[c] = t[c]; month[c] = m[c]; }
+  day = d;
+  monthNo = monthOfDay(d);
+}
+
+bool DemandMeter::tick(uint32_t tnow, const Readings &s){
+  uint32_t now = hal::millis();
+  if(!primed){
+    for(uint8_t i=0;i<NUM_LOADS;i++) lastUWh[i] = s.r[i].uWh;
+    bucketStart = now;
+    primed = true;
+  }
+  if(s.day && s.day!=day) newDay(s.day);
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    int64_t e = s.r[i].uWh-lastUWh[i];
+    lastUWh[i] = s.r[i].uWh;
+    if(e<0) e = 0;
+    cur[i] += (uint32_t)e;
+    cur[DEMAND_TOTAL] += (uint32_t)e;
+  }
+  uint8_t w = clampDemandWindow(demandWindowMin);
+  if(w!=window){ window = w; resum(); }
+  if(now-bucketStart < DEMAND_BUCKET_MS) return false;
+  bucketStart = (now-bucketStart < 2*DEMAND_BUCKET_MS) ? bucketStart+DEMAND_BUCKET_MS : now;
+  closeBucket(tnow);
+  return true;
+}
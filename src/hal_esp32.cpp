@@ -0,0 +1,77 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_INA219.h>
+#include <stdarg.h>
+#include <string.h>
+#include "time.h"
+#include "hal.h"
+
+// ---------------- CONFIG ----------------
+const int RELAY_PINS[4] = {16,17,18,19};
+#define RELAY_ON HIGH
+#define RELAY_OFF LOW
+
+// 4 INA219 sensors
+Adafruit_INA219 ina1(0x40);
+Adafruit_INA219 ina2(0x41);
+Adafruit_INA219 ina3(0x44);
+Adafruit_INA219 ina4(0x45);
+Adafruit_INA219* INA[4] = {&ina1, &ina2, &ina3, &ina4};
+
+// RTC slow memory, not cleared by the startup code
+RTC_NOINIT_ATTR static uint8_t rtcMem[hal::RTC_BYTES];
+
+namespace hal {
+
+uint32_t millis(){ return ::millis(); }
+uint32_t micros(){ return ::micros(); }
+uint32_t epoch(){ return (uint32_t)time(nullptr); }
+uint32_t cycles(){ return ESP.getCycleCount(); }
+uint32_t cyclesPerUs(){
+  static uint32_t mhz = ESP.getCpuFreqMHz();
+  return mhz;
+}
+
+void initRelays(){
+  for(int i=0;i<4;i++){
+    pinMode(RELAY_PINS[i],OUTPUT);
+    digitalWrite(RELAY_PINS[i],RELAY_OFF);
+  }
+}
+
+void setRelay(uint8_t i, bool on){
+  digitalWrite(RELAY_PINS[i], on ? RELAY_ON : RELAY_OFF);
+}
+
+bool initSensor(uint8_t i){
+  bool ok = INA[i]->begin();
+  Wire.setClock(400000); // fast-mode I2C keeps 4 sensors well inside a 5 ms period
+  return ok;
+}
+
+bool readSensor(uint8_t i, float &volts, float &amps){
+  volts = INA[i]->getBusVoltage_V();
+  amps = INA[i]->getCurrent_mA()/1000.0f;
+  return true;
+}
+
+bool rtcLoad(void* out, size_t n){
+  if(n>sizeof(rtcMem)) return false;
+  memcpy(out, rtcMem, n);
+  return true;
+}
+
+void rtcStore(const void* in, size_t n){
+  if(n<=sizeof(rtcMem)) memcpy(rtcMem, in, n);
+}
+
+void logf(const char* fmt, ...){
+  char buf[160];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  Serial.println(buf);
+}
+
+}
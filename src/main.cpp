@@ -2,81 +2,84 @@
 #include <WebServer.h>
 #include <WebSocketsServer.h>
 #include <SPIFFS.h>
-#include <Adafruit_INA219.h>
 #include <ArduinoJson.h>
+#include <stdarg.h>
 #include "time.h"
+#include "hal.h"
+#include "sampler.h"
+#include "control.h"
+#include "settings.h"
+#include "recorder.h"
+#include "checkpoint.h"
+#include "tariff.h"
+#include "demand.h"
+#include "wsapi.h"
+#include "metrics.h"
+#include "webassets.h"
 
 // ---------------- CONFIG ----------------
 const char* WIFI_SSID = "Redmi5G";
 const char* WIFI_PASSWORD = "12345678";
 
-const int RELAY_PINS[4] = {16,17,18,19};
-#define RELAY_ON HIGH
-#define RELAY_OFF LOW
-
-// 4 INA219 sensors
-Adafruit_INA219 ina1(0x40);
-Adafruit_INA219 ina2(0x41);
-Adafruit_INA219 ina3(0x44);
-Adafruit_INA219 ina4(0x45);
-Adafruit_INA219* INA[4] = {&ina1, &ina2, &ina3, &ina4};
-bool inaPresent[4] = {false,false,false,false};
-
 // Web
 WebServer server(80);
 WebSocketsServer webSocket(81);
 
 // SPIFFS files
-const char* SETTINGS_FILE = "/settings.json";
-const char* LOGS_FILE     = "/logs.json";
-const char* NOTIFS_FILE   = "/notifs.json";
+const char* NOTIFS_FILE   = "/notifs.log";
+const char* LEGACY_NOTIFS_FILE = "/notifs.json";
+const char* CHECKPOINT_FILE = "/energy.ckpt";
+const char* DAYS_FILE = "/days.log";
 
 // Time config
 const char* ntpServer = "pool.ntp.org";
 const long gmtOffset_sec = 19800; // UTC+5:30
 const int daylightOffset_sec = 0;
 
-// ---------------- Struct ----------------
-struct Load {
-  float V=0, I=0, P=0;
-  double Wh=0;
-  double cost=0;
-  bool relay=false;
-  unsigned long onSecondsToday=0;
-  unsigned long usageLimitSeconds=12UL*3600;
-  int timerMinutes=0;
-  unsigned long timerEndEpoch=0;
-};
-Load L[4];
+// Sampling task (pinned next to loop() but at a higher priority)
+const BaseType_t SAMPLER_CORE = 1;
+const UBaseType_t SAMPLER_PRIO = 2;
+const uint32_t SAMPLER_STACK = 4096;
 
-double unitPrice = 8.0;
+// ---------------- State ----------------
+TaskHandle_t samplerHandle = nullptr;
 unsigned long lastSec = 0;
 
-// ---------------- Forward decl ----------------
-void broadcastState();
-void saveSettingsToFS();
-void saveLogsToFS();
-void pushNotification(const String &s);
-void loadSettingsFromFS();
-void loadLogsFromFS();
-void loadNotifsFromFS();
-void addLogEntry(const String &period,const String &key,const String &payload);
+// Notifications
+const size_t NOTIF_PAGE_MAX = 100;
+
 bool fileExists(const char* path){ return SPIFFS.exists(path); }
 
 // ---------------- WiFi ----------------
-void connectWiFi(){
+// Connecting and NTP both run in the background: the loads are metered and
+// controllable from the first milliseconds after reset, network or not.
+void startWiFi(){
   WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  Serial.print("Connecting WiFi");
-  unsigned long start = millis();
-  while(WiFi.status()!=WL_CONNECTED && millis()-start<20000){
-    delay(300); Serial.print(".");
-  }
-  Serial.println();
-  if(WiFi.status()==WL_CONNECTED){
-    Serial.print("Connected. IP: "); Serial.println(WiFi.localIP());
-  } else Serial.println("WiFi connection failed!");
   configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+  Serial.println("Connecting WiFi in the background");
+}
+
+// Once a second from loop(): logs link changes and notes the NTP step.
+void networkTick(uint32_t tnow){
+  static bool linked = false;
+  static uint32_t lastEpoch = 0;
+  bool up = WiFi.status()==WL_CONNECTED;
+  if(up!=linked){
+    linked = up;
+    if(up){
+      bootMark(bootTimes.wifi, millis());
+      Serial.print("WiFi connected. IP: "); Serial.println(WiFi.localIP());
+    } else Serial.println("WiFi lost; reconnecting");
+  }
+  if(bootTimes.ntp==BOOT_PENDING && tnow>=EPOCH_VALID){
+    bootMark(bootTimes.ntp, millis());
+    // Timers set before the sync ran on the unsynced clock
+    if(lastEpoch) shiftTimers((int32_t)(tnow-lastEpoch-1));
+    Serial.println("Clock synced");
+  }
+  lastEpoch = tnow;
 }
 
 // ---------------- SPIFFS ----------------
@@ -85,226 +88,488 @@ void initSPIFFS(){
   else Serial.println("SPIFFS mounted.");
 }
 
-// ---------------- Settings ----------------
-void saveSettingsToFS(){
-  StaticJsonDocument<512> doc;
-  doc["unitPrice"] = unitPrice;
-  JsonArray loads = doc.createNestedArray("loads");
-  for(int i=0;i<4;i++){
-    JsonObject o = loads.createNestedObject();
-    o["limitSec"] = L[i].usageLimitSeconds;
-    o["timerMin"] = L[i].timerMinutes;
-  }
-  File f = SPIFFS.open(SETTINGS_FILE, FILE_WRITE);
-  if(f){ serializeJson(doc,f); f.close(); }
-  else Serial.println("Failed to open settings file for writing");
+// ---------------- WebSocket ----------------
+void handleWS(uint8_t num, WStype_t type, uint8_t * payload, size_t length){
+  if(type == WStype_CONNECTED) wsConnected(num);
+  else if(type == WStype_DISCONNECTED) wsDisconnected(num);
+  else if(type == WStype_TEXT) wsCommand(num, (char*)payload, length);
 }
 
-void loadSettingsFromFS(){
-  if(!fileExists(SETTINGS_FILE)){ saveSettingsToFS(); return; }
-  File f = SPIFFS.open(SETTINGS_FILE, FILE_READ);
-  if(!f){ Serial.println("Failed to open settings"); return; }
-  StaticJsonDocument<512> doc;
-  DeserializationError err = deserializeJson(doc,f);
+void wsSendText(uint8_t num, const char* s, size_t n){ webSocket.sendTXT(num, s, n); }
+void wsBroadcastText(const char* s, size_t n){ webSocket.broadcastTXT(s, n); }
+void wsSendBin(uint8_t num, const uint8_t* b, size_t n){ webSocket.sendBIN(num, b, n); }
+
+// ---------------- HTTP (static files) ----------------
+// Indexed assets (see webassets.h) are routed without touching flash. They
+// revalidate with If-None-Match (304, no body); requests carrying the
+// current ?v=<etag> may be cached for good.
+void serveAsset(const Asset &a){
+  bool versioned = server.arg("v") == a.etag;
+  server.sendHeader("Cache-Control", versioned ? "public, max-age=31536000, immutable" : "no-cache");
+  server.sendHeader("ETag", String("\"")+a.etag+"\"");
+  if(etagMatches(server.header("If-None-Match").c_str(), a.etag)){ server.send(304); return; }
+  char fsPath[ASSET_PATH_LEN+3];
+  snprintf(fsPath, sizeof(fsPath), a.gz ? "%s.gz" : "%s", a.path);
+  File f = SPIFFS.open(fsPath,"r");
+  if(!f){ server.send(404,"text/plain","Not found"); return; }
+  server.streamFile(f,CONTENT_TYPES[a.type]);   // adds Content-Encoding: gzip for a .gz name
   f.close();
-  if(err){ Serial.println("Settings JSON parse fail"); return; }
-  if(doc.containsKey("unitPrice")) unitPrice = doc["unitPrice"].as<double>();
-  if(doc.containsKey("loads")){
-    JsonArray arr = doc["loads"].as<JsonArray>();
-    for(int i=0;i<4 && i<(int)arr.size();i++){
-      if(arr[i].containsKey("limitSec")) L[i].usageLimitSeconds = arr[i]["limitSec"].as<unsigned long>();
-      if(arr[i].containsKey("timerMin")) L[i].timerMinutes = arr[i]["timerMin"].as<int>();
-    }
+}
+
+// Files the firmware writes at runtime (settings.json) are not in the index.
+void handleFileRead(String path){
+  if(path.endsWith("/")) path += "index.html";
+  const Asset* a = assets.find(path.c_str());
+  if(a){ serveAsset(*a); return; }
+  if(!SPIFFS.exists(path)){ server.send(404,"text/plain","Not found"); return; }
+  File f = SPIFFS.open(path,"r");
+  server.streamFile(f,CONTENT_TYPES[contentTypeOf(path.c_str())]);
+  f.close();
+}
+
+// ---------------- HTTP (raw samples) ----------------
+// Newest raw samples of one load, to see inrush and spikes inside a window.
+void handleSamples(){
+  int id = server.arg("load").toInt();
+  if(id<1 || id>4){ server.send(400,"text/plain","Bad load"); return; }
+  static RawSample buf[RING_SAMPLES];
+  size_t n = CH[id-1].ring.latest(buf, RING_SAMPLES);
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200,"application/json","");
+  char out[512]; size_t len=0;
+  len += snprintf(out, sizeof(out), "{\"hz\":%u,\"samples\":[", (unsigned)sampleHz);
+  for(size_t k=0;k<n;k++){
+    if(len > sizeof(out)-48){ server.sendContent(out,len); len=0; }
+    len += snprintf(out+len, sizeof(out)-len, "%s[%lu,%.3f,%.4f]", k?",":"",
+                    (unsigned long)buf[k].tUs, buf[k].v, buf[k].i);
   }
+  len += snprintf(out+len, sizeof(out)-len, "]}");
+  server.sendContent(out,len);
+  server.sendContent("");
 }
 
-// ---------------- Notifications ----------------
-void pushNotification(const String &s){
-  Serial.println("NOTIF: "+s);
-  StaticJsonDocument<1024> doc;
-  if(fileExists(NOTIFS_FILE)){
-    File f = SPIFFS.open(NOTIFS_FILE, FILE_READ);
-    if(f){
-      deserializeJson(doc,f);
-      f.close();
-    }
+// ---------------- HTTP (history) ----------------
+const uint32_t HISTORY_MAX_POINTS = 720;
+const char* TIER_NAMES[TIER_COUNT] = {"raw","min","hour","day"};
+
+// Streams /api/history as chunked JSON through one small buffer, so the
+// RAM used does not depend on the length of the range.
+struct HistoryOut {
+  uint8_t mask;
+  bool first;
+  size_t len;
+  char buf[512];
+};
+
+void historyWrite(HistoryOut &o, const char* s, size_t n){
+  if(o.len+n > sizeof(o.buf)){ server.sendContent(o.buf,o.len); o.len=0; }
+  memcpy(o.buf+o.len,s,n); o.len+=n;
+}
+
+void historyEmit(const TsBucket &b, void* ctx){
+  HistoryOut &o = *(HistoryOut*)ctx;
+  char line[192]; int n;
+  n = snprintf(line,sizeof(line),"%s{\"t\":%lu,\"wh\":[",o.first?"":",",(unsigned long)b.t);
+  for(int l=0,k=0;l<TS_LOADS;l++) if(o.mask&(1<<l)) n += snprintf(line+n,sizeof(line)-n,"%s%.3f",k++?",":"",b.uWh[l]/1e6);
+  n += snprintf(line+n,sizeof(line)-n,"],\"pk\":[");
+  for(int l=0,k=0;l<TS_LOADS;l++) if(o.mask&(1<<l)) n += snprintf(line+n,sizeof(line)-n,"%s%.2f",k++?",":"",b.pMax[l]/100.0f);
+  n += snprintf(line+n,sizeof(line)-n,"],\"on\":[");
+  for(int l=0,k=0;l<TS_LOADS;l++) if(o.mask&(1<<l)) n += snprintf(line+n,sizeof(line)-n,"%s%lu",k++?",":"",(unsigned long)b.onSec[l]);
+  n += snprintf(line+n,sizeof(line)-n,"]}");
+  historyWrite(o,line,n);
+  o.first=false;
+}
+
+// GET /api/history?from=&to=&load=&step=  (epoch seconds; load 1-4, omit for all)
+// Buckets come from the coarsest tier that fits step, or a coarser one if
+// that tier no longer reaches back to from; step is raised so a response
+// never holds more than HISTORY_MAX_POINTS buckets.
+void handleHistory(){
+  uint32_t now = time(nullptr);
+  uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(),nullptr,10) : now;
+  uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(),nullptr,10) : to-86400;
+  uint32_t step = server.hasArg("step") ? strtoul(server.arg("step").c_str(),nullptr,10) : 0;
+  int load = server.hasArg("load") ? server.arg("load").toInt() : 0;
+  if(to<=from || load<0 || load>4){ server.send(400,"text/plain","Bad range"); return; }
+
+  uint32_t minStep = (to-from+HISTORY_MAX_POINTS-1)/HISTORY_MAX_POINTS;
+  if(step<minStep) step=minStep;
+  Tier tier = history.pickTier(from,step);
+  uint32_t bucket = TIERS[tier].bucketSec;
+  step = (step+bucket-1)/bucket*bucket;
+
+  static HistoryOut out;
+  out.mask = load ? 1<<(load-1) : 0x0F;
+  out.first = true; out.len = 0;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200,"application/json","");
+  char head[160];
+  int n = snprintf(head,sizeof(head),"{\"from\":%lu,\"to\":%lu,\"step\":%lu,\"tier\":\"%s\",\"loads\":[",
+                   (unsigned long)from,(unsigned long)to,(unsigned long)step,TIER_NAMES[tier]);
+  for(int l=0,k=0;l<TS_LOADS;l++) if(out.mask&(1<<l)) n += snprintf(head+n,sizeof(head)-n,"%s%d",k++?",":"",l+1);
+  n += snprintf(head+n,sizeof(head)-n,"],\"points\":[");
+  historyWrite(out,head,n);
+
+  static TsBucketer bucketer;
+  bucketer.begin(from,step,historyEmit,&out);
+  history.scan(tier,from,to,TsBucketer::visit,&bucketer);
+  bucketer.finish();
+
+  n = snprintf(head,sizeof(head),"],\"count\":%lu}",(unsigned long)bucketer.emitted);
+  historyWrite(out,head,n);
+  server.sendContent(out.buf,out.len);
+  server.sendContent("");
+}
+
+// ---------------- HTTP (daily ledger) ----------------
+// Closed days in [from, to) (epoch s, default the last 31 days), then the
+// running day from the live counters. Each day carries its peak demand per load
+// and for the panel.
+const uint16_t DAYS_PAGE_MAX = 62;
+
+// peakMw / peakMin: DEMAND_CHANNELS each (loads, then the panel); minutes
+// become epoch times, DEMAND_NO_MINUTE null.
+static int dayJson(char* out, size_t cap, uint16_t day, const uint32_t* onSec, const int64_t* uWh, const int64_t* cost,
+                   const uint32_t* peakMw, const uint16_t* peakMin){
+  uint32_t t0 = (uint32_t)day*86400-gmtOffset_sec;
+  int n = snprintf(out,cap,"{\"t\":%lu,\"wh\":[",(unsigned long)t0);
+  for(int i=0;i<NUM_LOADS;i++) n += snprintf(out+n,cap-n,"%s%.3f",i?",":"",uWh[i]/1e6);
+  n += snprintf(out+n,cap-n,"],\"on\":[");
+  for(int i=0;i<NUM_LOADS;i++) n += snprintf(out+n,cap-n,"%s%lu",i?",":"",(unsigned long)onSec[i]);
+  n += snprintf(out+n,cap-n,"],\"cost\":[");
+  for(int i=0;i<NUM_LOADS;i++) n += snprintf(out+n,cap-n,"%s%.3f",i?",":"",cost[i]/1000.0);
+  n += snprintf(out+n,cap-n,"],\"peak\":[");
+  for(int c=0;c<DEMAND_CHANNELS;c++) n += snprintf(out+n,cap-n,"%s%.3f",c?",":"",peakMw[c]/1000.0);
+  n += snprintf(out+n,cap-n,"],\"peakAt\":[");
+  for(int c=0;c<DEMAND_CHANNELS;c++){
+    if(peakMin[c]==DEMAND_NO_MINUTE) n += snprintf(out+n,cap-n,"%snull",c?",":"");
+    else n += snprintf(out+n,cap-n,"%s%lu",c?",":"",(unsigned long)(t0+peakMin[c]*60));
   }
-  if(!doc.containsKey("notifs")) doc.createNestedArray("notifs");
-  JsonArray arr = doc["notifs"].as<JsonArray>();
-  JsonObject o = arr.createNestedObject();
-  o["ts"] = time(nullptr);
-  o["text"] = s;
-  File fw = SPIFFS.open(NOTIFS_FILE, FILE_WRITE);
-  if(fw){ serializeJson(doc,fw); fw.close(); }
-  DynamicJsonDocument out(256);
-  out["type"] = "notification"; out["text"] = s;
-  String outS; serializeJson(out,outS);
-  webSocket.broadcastTXT(outS);
+  n += snprintf(out+n,cap-n,"]}");
+  return n;
 }
 
-// ---------------- WebSocket ----------------
-void handleWS(uint8_t num, WStype_t type, uint8_t * payload, size_t length){
-  if(type != WStype_TEXT) return;
-  String msg = String((char*)payload);
-  StaticJsonDocument<512> doc;
-  if(deserializeJson(doc,msg)){ Serial.println("WS JSON parse error"); return; }
-  const char* cmd = doc["cmd"];
-  if(!cmd) return;
-
-  if(strcmp(cmd,"relay")==0){
-    int id = doc["id"] | 1; bool state = doc["state"] | false;
-    if(id>=1 && id<=4){
-      digitalWrite(RELAY_PINS[id-1], state ? RELAY_ON : RELAY_OFF);
-      L[id-1].relay = state;
-      if(state && L[id-1].timerMinutes>0) L[id-1].timerEndEpoch = time(nullptr)+L[id-1].timerMinutes*60;
-      else L[id-1].timerEndEpoch=0;
-      pushNotification("Relay "+String(id)+(state?" ON":" OFF"));
+void handleDays(){
+  Readings s = readings.read();
+  uint32_t now = time(nullptr);
+  uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(),nullptr,10) : now;
+  uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(),nullptr,10) : to-31*86400;
+  uint16_t d0 = localDay(from, gmtOffset_sec), d1 = localDay(to, gmtOffset_sec);
+  if(!d0 || d1<d0){ server.send(400,"text/plain","Bad range"); return; }
+  if(d1-d0>DAYS_PAGE_MAX) d0 = d1-DAYS_PAGE_MAX;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200,"application/json","");
+  char line[448];
+  server.sendContent("{\"days\":[");
+  bool first = true;
+  DayRecord r;
+  for(uint16_t d=d0; d<=d1; d++){
+    if(d==s.day || !days.read(d,r)) continue;
+    line[0]=',';
+    int n = first ? 0 : 1;
+    n += dayJson(line+n,sizeof(line)-n,d,r.onSec,r.uWh,r.costMilli,r.peakMw,r.peakMin);
+    server.sendContent(line,n);
+    first = false;
+  }
+  server.sendContent("],\"today\":");
+  if(s.day){
+    uint32_t on[NUM_LOADS]; int64_t wh[NUM_LOADS], cost[NUM_LOADS];
+    for(int i=0;i<NUM_LOADS;i++){ on[i]=s.r[i].onSecondsToday; wh[i]=s.r[i].uWhToday; cost[i]=s.r[i].costToday; }
+    uint32_t pk[DEMAND_CHANNELS]; uint16_t at[DEMAND_CHANNELS];
+    for(int c=0;c<DEMAND_CHANNELS;c++){
+      const DemandPeak &p = demand.today[c];
+      pk[c] = p.mW;
+      at[c] = p.at ? (p.at+gmtOffset_sec)%86400/60 : DEMAND_NO_MINUTE;
     }
-  } else if(strcmp(cmd,"setTimer")==0){
-    int id=doc["id"]|1; int m=doc["minutes"]|0;
-    if(id>=1 && id<=4){ 
-      L[id-1].timerMinutes=m; 
-      if(L[id-1].relay && m>0) L[id-1].timerEndEpoch=time(nullptr)+m*60; 
-      else L[id-1].timerEndEpoch=0; 
-      saveSettingsToFS();
+    server.sendContent(line,dayJson(line,sizeof(line),s.day,on,wh,cost,pk,at));
+  } else server.sendContent("null");
+  server.sendContent("}");
+  server.sendContent("");
+}
+
+// ---------------- HTTP (notifications) ----------------
+// GET /api/notifs?since=&limit=  Entries with seq > since, oldest first; without
+// since, the newest `limit`. "last" is the cursor for the next poll.
+void handleNotifs(){
+  uint32_t since = server.hasArg("since") ? strtoul(server.arg("since").c_str(),nullptr,10) : 0;
+  size_t limit = server.hasArg("limit") ? server.arg("limit").toInt() : 50;
+  if(limit<1) limit=1;
+  if(limit>NOTIF_PAGE_MAX) limit=NOTIF_PAGE_MAX;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200,"application/json","");
+  // Worst case every text byte is escaped as \u00XX; plus seq, ts and keys.
+  char line[NOTIF_TEXT_LEN*6+64];
+  int n = snprintf(line,sizeof(line),"{\"first\":%lu,\"last\":%lu,\"notifs\":[",
+                   (unsigned long)notifLog.first(),(unsigned long)notifLog.last());
+  server.sendContent(line,n);
+
+  if(!server.hasArg("since")) since = notifLog.last()>limit ? notifLog.last()-limit : 0;
+  NotifSlot page[8];
+  size_t sent=0;
+  while(sent<limit){
+    size_t got = notifLog.read(since, page, min(limit-sent, sizeof(page)/sizeof(page[0])));
+    if(!got) break;
+    for(size_t k=0;k<got;k++){
+      StaticJsonDocument<192> o;
+      o["seq"]=page[k].seq; o["ts"]=page[k].ts;
+      char text[NOTIF_TEXT_LEN+1];
+      memcpy(text,page[k].text,page[k].len); text[page[k].len]=0;
+      o["text"]=(const char*)text;
+      n = sent+k ? 1 : 0;
+      line[0]=',';
+      n += serializeJson(o,line+n,sizeof(line)-n);
+      server.sendContent(line,n);
     }
-  } else if(strcmp(cmd,"setLimit")==0){
-    int id=doc["id"]|1; unsigned long s=doc["seconds"]|0;
-    if(id>=1 && id<=4 && s>0){ L[id-1].usageLimitSeconds=s; saveSettingsToFS(); }
-  } else if(strcmp(cmd,"setPrice")==0){ 
-    unitPrice=doc["price"]|8.0; 
-    saveSettingsToFS();
-  } else if(strcmp(cmd,"clearNotifs")==0){ 
-    SPIFFS.remove(NOTIFS_FILE); 
-    pushNotification("Notifs cleared"); 
+    sent += got;
+    since = page[got-1].seq;
   }
+  server.sendContent("]}");
+  server.sendContent("");
 }
 
-// ---------------- HTTP (static files) ----------------
-void handleFileRead(String path){
-  if(path.endsWith("/")) path += "index.html";
-  String ct="text/plain";
-  if(path.endsWith(".html")) ct="text/html";
-  else if(path.endsWith(".js")) ct="application/javascript";
-  else if(path.endsWith(".css")) ct="text/css";
-  else if(path.endsWith(".json")) ct="application/json";
-  else if(path.endsWith(".ico")) ct="image/x-icon";
+// ---------------- HTTP (demand) ----------------
+// GET /api/demand  Sliding-window demand now, over the last minute, and the
+// day's and month's peaks, per load and (last) for the panel. W, epoch s.
+void handleDemand(){
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200,"application/json","");
+  char line[200];
+  int n = snprintf(line,sizeof(line),"{\"window\":%u,\"full\":%s,\"limit\":%lu,\"loads\":[",
+                   (unsigned)demand.windowMin(),demand.full()?"true":"false",(unsigned long)demandLimitW);
+  server.sendContent(line,n);
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+    const DemandPeak &d = demand.today[c], &m = demand.month[c];
+    n = snprintf(line,sizeof(line),"%s{\"now\":%.3f,\"lastMin\":%.3f,\"today\":%.3f,\"todayAt\":%lu,\"month\":%.3f,\"monthAt\":%lu}",
+                 c?",":"",demand.demandMw[c]/1000.0,demand.lastMw[c]/1000.0,
+                 d.mW/1000.0,(unsigned long)d.at,m.mW/1000.0,(unsigned long)m.at);
+    server.sendContent(line,n);
+  }
+  server.sendContent("]}");
+  server.sendContent("");
+}
 
-  if(!SPIFFS.exists(path)){ server.send(404,"text/plain","Not found"); return; }
-  File f = SPIFFS.open(path,"r");
-  server.streamFile(f,ct);
-  f.close();
+// ---------------- HTTP (tariff) ----------------
+// GET /api/tariff   The rate in effect and the stored schedule (tariff.h),
+//                   null when the flat unitPrice applies.
+// POST /api/tariff  Body: a schedule. {} goes back to the flat price.
+void handleTariffGet(){
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200,"application/json","");
+  char line[64];
+  int n = snprintf(line,sizeof(line),"{\"rate\":%.3f,\"schedule\":",sampler.rateMilli/1000.0);
+  server.sendContent(line,n);
+  File f = SPIFFS.open(TARIFF_FILE, FILE_READ);
+  if(f){
+    char buf[256];
+    while((n = f.read((uint8_t*)buf,sizeof(buf)))>0) server.sendContent(buf,n);
+    f.close();
+  } else server.sendContent("null");
+  server.sendContent("}");
+  server.sendContent("");
 }
 
-// ---------------- Broadcast ----------------
-void broadcastState(){
-  DynamicJsonDocument doc(1024);
-  doc["type"]="state"; doc["unitPrice"]=unitPrice;
-  JsonArray arr = doc.createNestedArray("loads");
-  for(int i=0;i<4;i++){
-    JsonObject o=arr.createNestedObject();
-    o["id"]=i+1; o["voltage"]=L[i].V; o["current"]=L[i].I; o["power"]=L[i].P; o["energy"]=L[i].Wh;
-    o["relay"]=L[i].relay; o["onSecToday"]=L[i].onSecondsToday; o["limitSec"]=L[i].usageLimitSeconds;
-    o["timerMin"]=L[i].timerMinutes; if(L[i].timerEndEpoch>0) o["timerEnd"]=L[i].timerEndEpoch; o["cost"]=L[i].cost;
-  }
-  String out; serializeJson(doc,out); webSocket.broadcastTXT(out);
+void handleTariffSet(){
+  const String &body = server.arg("plain");
+  const char* err = setTariff(body.c_str(), body.length());
+  if(err){ server.send(400,"text/plain",err); return; }
+  server.send(204);
 }
 
-// ---------------- Setup ----------------
-void setup(){
-  Serial.begin(115200);
-  initSPIFFS(); 
-  connectWiFi();
+// ---------------- HTTP (metrics) ----------------
+struct MetricsOut {
+  size_t len;
+  char buf[512];
+};
 
-  for(int i=0;i<4;i++){ 
-    pinMode(RELAY_PINS[i],OUTPUT); 
-    digitalWrite(RELAY_PINS[i],RELAY_OFF); 
-    L[i].relay=false; 
+void metricsEmit(const char* s, size_t n, void* ctx){
+  MetricsOut &o = *(MetricsOut*)ctx;
+  if(o.len+n > sizeof(o.buf)){ server.sendContent(o.buf,o.len); o.len=0; }
+  memcpy(o.buf+o.len,s,n); o.len+=n;
+}
+
+void metricsLine(MetricsOut &o, const char* fmt, ...){
+  char line[128];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if(n>0) metricsEmit(line, n<(int)sizeof(line) ? n : sizeof(line)-1, &o);
+}
+
+// GET /metrics  Prometheus text: loop phase and tick lateness histograms,
+// heap, WS clients and flash write counters.
+void handleMetrics(){
+  static MetricsOut out;
+  out.len = 0;
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200,"text/plain; version=0.0.4","");
+
+  metricsLine(out,"# HELP pt_loop_phase_seconds Time spent per loop() phase; ina runs on the sampler task.\n");
+  metricsLine(out,"# TYPE pt_loop_phase_seconds histogram\n");
+  char label[24];
+  for(uint8_t p=0;p<PHASE_COUNT;p++){
+    snprintf(label,sizeof(label),"phase=\"%s\"",PHASE_NAMES[p]);
+    writeHistogram("pt_loop_phase_seconds",label,phaseHist[p],metricsEmit,&out);
+  }
+  metricsLine(out,"# HELP pt_loop_phase_max_seconds Slowest run of each phase since boot.\n");
+  metricsLine(out,"# TYPE pt_loop_phase_max_seconds gauge\n");
+  for(uint8_t p=0;p<PHASE_COUNT;p++)
+    metricsLine(out,"pt_loop_phase_max_seconds{phase=\"%s\"} %.6f\n",PHASE_NAMES[p],phaseHist[p].maxUs/1e6);
+  metricsLine(out,"# HELP pt_tick_late_seconds How far past its 1 s mark the tick ran.\n");
+  metricsLine(out,"# TYPE pt_tick_late_seconds histogram\n");
+  writeHistogram("pt_tick_late_seconds",nullptr,tickLate,metricsEmit,&out);
+
+  metricsLine(out,"# TYPE pt_heap_free_bytes gauge\npt_heap_free_bytes %u\n",(unsigned)ESP.getFreeHeap());
+  metricsLine(out,"# TYPE pt_heap_min_free_bytes gauge\npt_heap_min_free_bytes %u\n",(unsigned)ESP.getMinFreeHeap());
+  metricsLine(out,"# TYPE pt_heap_largest_block_bytes gauge\npt_heap_largest_block_bytes %u\n",(unsigned)ESP.getMaxAllocHeap());
+  metricsLine(out,"# TYPE pt_ws_clients gauge\npt_ws_clients %u\n",(unsigned)__builtin_popcount(wsClients));
+  metricsLine(out,"# TYPE pt_ws_state_max_bytes gauge\npt_ws_state_max_bytes %lu\n",(unsigned long)wsTx.maxPayload);
+  metricsLine(out,"# TYPE pt_ws_state_arena_max_bytes gauge\npt_ws_state_arena_max_bytes %lu\n",(unsigned long)wsTx.maxArena);
+  metricsLine(out,"# TYPE pt_ws_state_truncated_total counter\npt_ws_state_truncated_total %lu\n",(unsigned long)wsTx.truncated);
+  metricsLine(out,"# TYPE pt_uptime_seconds gauge\npt_uptime_seconds %lu\n",(unsigned long)(millis()/1000));
+  metricsLine(out,"# TYPE pt_sample_hz gauge\npt_sample_hz %u\n",(unsigned)sampleHz);
+  metricsLine(out,"# HELP pt_boot_milestone_seconds Time from reset to each boot milestone; absent until reached.\n");
+  metricsLine(out,"# TYPE pt_boot_milestone_seconds gauge\n");
+  const char* const names[] = {"first_sample","first_broadcast","wifi","ntp"};
+  const uint32_t at[] = {bootTimes.firstSample, bootTimes.firstBroadcast, bootTimes.wifi, bootTimes.ntp};
+  for(uint8_t k=0;k<4;k++)
+    if(at[k]!=BOOT_PENDING) metricsLine(out,"pt_boot_milestone_seconds{milestone=\"%s\"} %.3f\n",names[k],at[k]/1e3);
+
+  metricsLine(out,"# HELP pt_flash_writes_total Writes issued to SPIFFS, by file.\n");
+  metricsLine(out,"# TYPE pt_flash_writes_total counter\n");
+  metricsLine(out,"pt_flash_writes_total{file=\"history\"} %lu\n",(unsigned long)history.pageWrites);
+  metricsLine(out,"pt_flash_writes_total{file=\"notifs\"} %lu\n",(unsigned long)notifLog.writes);
+  metricsLine(out,"pt_flash_writes_total{file=\"settings\"} %lu\n",(unsigned long)settingsSave.writes);
+  metricsLine(out,"pt_flash_writes_total{file=\"checkpoint\"} %lu\n",(unsigned long)checkpoints.writes);
+  metricsLine(out,"pt_flash_writes_total{file=\"days\"} %lu\n",(unsigned long)days.writes);
+  metricsLine(out,"# TYPE pt_settings_coalesced_total counter\npt_settings_coalesced_total %lu\n",(unsigned long)settingsSave.coalesced);
+  metricsLine(out,"# TYPE pt_history_dropped_total counter\npt_history_dropped_total %lu\n",(unsigned long)history.recordsDropped);
+  metricsLine(out,"# HELP pt_demand_watts Sliding-window average power, by load and for the panel.\n");
+  metricsLine(out,"# TYPE pt_demand_watts gauge\n");
+  metricsLine(out,"# HELP pt_demand_peak_watts Highest demand this month.\n");
+  metricsLine(out,"# TYPE pt_demand_peak_watts gauge\n");
+  for(uint8_t c=0;c<DEMAND_CHANNELS;c++){
+    char id[8];
+    if(c==DEMAND_TOTAL) strcpy(id,"total"); else snprintf(id,sizeof(id),"%u",c+1);
+    metricsLine(out,"pt_demand_watts{load=\"%s\"} %.3f\n",id,demand.demandMw[c]/1000.0);
+    metricsLine(out,"pt_demand_peak_watts{load=\"%s\"} %.3f\n",id,demand.month[c].mW/1000.0);
   }
+  metricsLine(out,"# HELP pt_tariff_rate Unit price in effect per kWh (time-of-use or flat).\n");
+  metricsLine(out,"# TYPE pt_tariff_rate gauge\npt_tariff_rate %.3f\n",sampler.rateMilli/1000.0);
+  metricsLine(out,"# TYPE pt_timers_pending gauge\npt_timers_pending %u\n",(unsigned)timers.pending);
+  metricsLine(out,"# TYPE pt_timers_fired_total counter\npt_timers_fired_total %lu\n",(unsigned long)timers.fired);
 
-  for(int i=0;i<4;i++){ 
-    if(INA[i]->begin()){ 
-      inaPresent[i]=true; 
-      Serial.printf("INA %d found\n",i+1); 
-    } else { 
-      inaPresent[i]=false; 
-      Serial.printf("INA %d NOT found\n",i+1); 
-    } 
+  server.sendContent(out.buf,out.len);
+  server.sendContent("");
+}
+
+// ---------------- Sampling task ----------------
+// Runs the sampler on a fixed vTaskDelayUntil period, regardless of what the
+// web server is doing.
+void samplerTask(void*){
+  TickType_t wake = xTaskGetTickCount();
+  for(;;){
+    TickType_t period = pdMS_TO_TICKS(1000/sampleHz);
+    if(period==0) period=1;
+    vTaskDelayUntil(&wake, period);
+    sampler.sample();
   }
+}
 
-  loadSettingsFromFS();
+void startSampler(){
+  xTaskCreatePinnedToCore(samplerTask, "sampler", SAMPLER_STACK, nullptr,
+                          SAMPLER_PRIO, &samplerHandle, SAMPLER_CORE);
+}
 
-  // -------- Static files (one-liner) --------
-  // Serve everything in /data as web root, defaulting to index.html
-  server.serveStatic("/", SPIFFS, "/");
+// ---------------- Setup ----------------
+void setup(){
+  Serial.begin(115200);
+  initSPIFFS(); 
 
-  // Optional explicit routes (keep for clarity)
+  // Metering and relay control first; nothing here waits on the network.
+  hal::initRelays();
+  controlBegin();
+  sampler.tzOffset = gmtOffset_sec;
+  sampler.begin();
+  loadSettingsFromFS();
+  loadTariff();
+  uint32_t t0 = micros();
+  if(!checkpoints.begin(CHECKPOINT_FILE)) Serial.println("Checkpoint ring unavailable");
+  const char* from = checkpoints.restore();
+  if(from) Serial.printf("Counters restored from %s (seq %lu) in %lu us\n", from,
+                         (unsigned long)checkpoints.last().seq, (unsigned long)(micros()-t0));
+  startSampler();
+
+  recorderBegin(gmtOffset_sec);
+  if(!days.begin(DAYS_FILE)) Serial.println("Daily ledger unavailable");
+  if(fileExists(LEGACY_NOTIFS_FILE)) SPIFFS.remove(LEGACY_NOTIFS_FILE);
+  if(!notifLog.begin(NOTIFS_FILE)) Serial.println("Notification log unavailable");
+  startWiFi();
+
+  // -------- Static files --------
+  Serial.printf("Asset index: %u files\n", (unsigned)assets.begin(ASSET_MANIFEST));
+  static const char* reqHeaders[] = {"If-None-Match"};
+  server.collectHeaders(reqHeaders, 1);
   server.on("/", [](){ handleFileRead("/index.html"); });
   server.on("/index.html", [](){ handleFileRead("/index.html"); });
   server.on("/styles.css", [](){ handleFileRead("/styles.css"); });
   server.on("/app.js", [](){ handleFileRead("/app.js"); });
-  server.on("/logs.json", [](){ handleFileRead("/logs.json"); });
   server.on("/settings.json", [](){ handleFileRead("/settings.json"); });
-  server.on("/notifs.json", [](){ handleFileRead("/notifs.json"); });
   server.on("/favicon.ico", [](){ handleFileRead("/favicon.ico"); }); // optional
+  server.on("/api/samples", handleSamples);
+  server.on("/api/history", handleHistory);
+  server.on("/api/notifs", handleNotifs);
+  server.on("/api/days", handleDays);
+  server.on("/api/demand", handleDemand);
+  server.on("/api/tariff", HTTP_GET, handleTariffGet);
+  server.on("/api/tariff", HTTP_POST, handleTariffSet);
+  server.on("/metrics", handleMetrics);
 
   // Catch-all: never trigger the internal "request handler not found"
   server.onNotFound([](){
-    // Try to serve the requested file from SPIFFS; if missing, fall back to index.html
-    String uri = server.uri();
-    if(uri == "/") uri = "/index.html";
-    if(SPIFFS.exists(uri)) { handleFileRead(uri); return; }
-    handleFileRead("/index.html"); // SPA fallback
+    // Indexed assets by path; anything else gets the SPA shell
+    const Asset* a = assets.find(server.uri().c_str());
+    if(a) serveAsset(*a);
+    else handleFileRead("/index.html");
   });
 
   server.begin();
   webSocket.begin(); 
   webSocket.onEvent(handleWS);
-  Serial.println("Server started at "+WiFi.localIP().toString());
+  Serial.printf("Up in %lu ms\n", (unsigned long)millis());
 }
 
 // ---------------- Loop ----------------
 void loop(){
+  uint32_t c = hal::cycles();
   webSocket.loop(); 
+  c = phaseDone(PH_WS, c);
   server.handleClient();
+  c = phaseDone(PH_HTTP, c);
+  if(flushSettingsIfDue()) c = phaseDone(PH_SETTINGS, c);
+  if(timers.advance(millis())) c = phaseDone(PH_CONTROL, c);
 
   unsigned long now=millis(); 
   if(now-lastSec<1000) return; 
+  if(lastSec) tickLate.observe((now-lastSec-1000)*1000);
   lastSec=now;
 
   time_t tnow=time(nullptr);
-
-  for(int i=0;i<4;i++){
-    if(inaPresent[i]){
-      float v=INA[i]->getBusVoltage_V();
-      float c=INA[i]->getCurrent_mA()/1000.0f; 
-      if(c<0)c=0;
-      float p=v*c; 
-      L[i].V=v; 
-      L[i].I=c; 
-      L[i].P=p;
-      L[i].Wh+=(p/3600.0); 
-      L[i].cost=(L[i].Wh/1000.0)*unitPrice;
-    } else { 
-      L[i].V=L[i].I=L[i].P=0; 
-    }
-
-    if(L[i].relay){
-      L[i].onSecondsToday++; 
-      if(L[i].usageLimitSeconds>0 && L[i].onSecondsToday>=L[i].usageLimitSeconds){
-        digitalWrite(RELAY_PINS[i],RELAY_OFF); 
-        L[i].relay=false; 
-        pushNotification("Relay "+String(i+1)+" auto OFF by limit"); 
-      }
-    }
-
-    if(L[i].timerEndEpoch>0 && tnow>=L[i].timerEndEpoch){
-      digitalWrite(RELAY_PINS[i],RELAY_OFF); 
-      L[i].relay=false; 
-      L[i].timerEndEpoch=0; 
-      pushNotification("Relay "+String(i+1)+" auto OFF by timer"); 
-    }
-  }
-
+  networkTick(tnow);
+  Readings s = readings.read();
+
+  c = hal::cycles();
+  controlTick(tnow);
+  if(demand.tick(tnow, s)) demandControl(demand);
+  c = phaseDone(PH_CONTROL, c);
+  recordHistory(tnow, s);
+  checkpoints.tick(tnow, s);
+  c = phaseDone(PH_HISTORY, c);
   broadcastState();
+  phaseDone(PH_BROADCAST, c);
+  bootMark(bootTimes.firstBroadcast, millis());
 }
@@ -0,0 +1,28 @@
+#include "meter.h"
+#include <math.h>
+
+Stat Agg::stat() const {
+  Stat s;
+  if(!n) return s;
+  s.min = mn; s.max = mx;
+  s.mean = sum / n;
+  s.rms = sqrtf(sq / n);
+  return s;
+}
+
+void Channel::add(uint32_t tUs, float v, float i, uint32_t priceMilli){
+  float p = v*i;
+  uint32_t pmW = p>0 ? (uint32_t)lroundf(p*1000.0f) : 0;
+  av.add(v); ai.add(i); ap.add(p);
+  if(primed) energy.add(lastPmW, pmW, tUs-lastUs, priceMilli);
+  primed = true; lastUs = tUs; lastPmW = pmW;
+  ring.push({tUs, v, i});
+}
+
+WindowStats Channel::closeWindow(){
+  WindowStats w;
+  w.v = av.stat(); w.i = ai.stat(); w.p = ap.stat();
+  w.n = ap.n;
+  av.reset(); ai.reset(); ap.reset();
+  return w;
+}
@@ -0,0 +1,52 @@
+#include "metrics.h"
+#include "hal.h"
+#include <stdio.h>
+
+const char* const PHASE_NAMES[PHASE_COUNT] = {"ws","http","settings","ina","control","history","broadcast"};
+
+const uint32_t HIST_BOUNDS_US[HIST_BUCKETS] = {
+  10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000
+};
+
+Histogram phaseHist[PHASE_COUNT];
+Histogram tickLate;
+BootTimes bootTimes = {BOOT_PENDING, BOOT_PENDING, BOOT_PENDING, BOOT_PENDING};
+
+void Histogram::observe(uint32_t us){
+  uint8_t b = 0;
+  while(b<HIST_BUCKETS && us>HIST_BOUNDS_US[b]) b++;
+  counts[b]++;
+  count++;
+  sumUs += us;
+  if(us>maxUs) maxUs = us;
+}
+
+uint32_t phaseDone(Phase p, uint32_t c0){
+  uint32_t c = hal::cycles();
+  phaseHist[p].observe((c-c0)/hal::cyclesPerUs());
+  return c;
+}
+
+void writeHistogram(const char* name, const char* label, const Histogram &h, MetricsEmit emit, void* ctx){
+  char line[96];
+  char sep = label ? ',' : '{';
+  const char* lab = label ? label : "";
+  uint64_t cum = 0;
+  int n;
+  for(uint8_t b=0;b<=HIST_BUCKETS;b++){
+    cum += h.counts[b];
+    if(b<HIST_BUCKETS)
+      n = snprintf(line,sizeof(line),"%s_bucket%s%s%cle=\"%g\"} %llu\n", name, label?"{":"", lab, sep,
+                   HIST_BOUNDS_US[b]/1e6, (unsigned long long)cum);
+    else
+      n = snprintf(line,sizeof(line),"%s_bucket%s%s%cle=\"+Inf\"} %llu\n", name, label?"{":"", lab, sep,
+                   (unsigned long long)cum);
+    emit(line,n,ctx);
+  }
+  const char* open = label ? "{" : "";
+  const char* close = label ? "}" : "";
+  n = snprintf(line,sizeof(line),"%s_sum%s%s%s %.6f\n", name, open, lab, close, h.sumUs/1e6);
+  emit(line,n,ctx);
+  n = snprintf(line,sizeof(line),"%s_count%s%s%s %llu\n", name, open, lab, close, (unsigned long long)h.count);
+  emit(line,n,ctx);
+}
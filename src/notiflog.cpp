@@ -0,0 +1,97 @@
+#include "notiflog.h"
+#include "crc.h"
+#include <SPIFFS.h>
+#include <string.h>
+
+static const size_t LOG_BYTES = (size_t)NOTIF_SLOTS*sizeof(NotifSlot);
+
+static bool slotValid(const NotifSlot& s){
+  return s.seq && (s.len<=NOTIF_TEXT_LEN || s.len==NOTIF_CLEARED) && crc16((const uint8_t*)&s,62)==s.crc;
+}
+
+// Writes LOG_BYTES of empty slots. Only at first boot or after a clear.
+bool NotifLog::format(){
+  if(f) f.close();
+  f = SPIFFS.open(path, FILE_WRITE);
+  if(!f) return false;
+  uint8_t zero[256];
+  memset(zero,0,sizeof(zero));
+  for(size_t o=0;o<LOG_BYTES;o+=sizeof(zero)) f.write(zero,sizeof(zero));
+  f.close();
+  f = SPIFFS.open(path, "r+");
+  return (bool)f;
+}
+
+bool NotifLog::begin(const char* p){
+  path = p;
+  if(!SPIFFS.exists(path)) return format();
+  f = SPIFFS.open(path, "r+");
+  if(!f || f.size()!=LOG_BYTES) return format();
+
+  // One pass at boot to find the head; appends are O(1) after that.
+  NotifSlot s;
+  uint32_t newest=0, oldest=0, cleared=0;
+  for(uint16_t i=0;i<NOTIF_SLOTS;i++){
+    if(f.read((uint8_t*)&s,sizeof(s))!=sizeof(s)) break;
+    if(!slotValid(s)) continue;
+    if(s.seq>newest) newest=s.seq;
+    if(s.len==NOTIF_CLEARED){ if(s.seq>cleared) cleared=s.seq; continue; }
+    if(!oldest || s.seq<oldest) oldest=s.seq;
+  }
+  next = newest+1;
+  clearedTo = oldest ? oldest : next;
+  if(clearedTo<=cleared) clearedTo = cleared+1;
+  return true;
+}
+
+void NotifLog::writeSlot(NotifSlot& s){
+  s.crc = crc16((const uint8_t*)&s,62);
+  if(f && f.seek((s.seq % NOTIF_SLOTS)*sizeof(NotifSlot))){
+    f.write((const uint8_t*)&s,sizeof(s));
+    f.flush();
+    writes++;
+  }
+}
+
+uint32_t NotifLog::append(uint32_t ts, const char* text){
+  NotifSlot s;
+  memset(&s,0,sizeof(s));
+  s.seq = next++;
+  s.ts = ts;
+  size_t n = strlen(text);
+  s.len = n>NOTIF_TEXT_LEN ? NOTIF_TEXT_LEN : n;
+  memcpy(s.text,text,s.len);
+  writeSlot(s);
+  return s.seq;
+}
+
+void NotifLog::clear(){
+  format();
+  clearedTo = next;
+  if(next==1) return;
+  NotifSlot s;
+  memset(&s,0,sizeof(s));
+  s.seq = next-1;
+  s.len = NOTIF_CLEARED;
+  writeSlot(s);
+}
+
+uint32_t NotifLog::first() const {
+  uint32_t ringStart = next>NOTIF_SLOTS ? next-NOTIF_SLOTS : 1;
+  return clearedTo>ringStart ? clearedTo : ringStart;
+}
+
+bool NotifLog::readSlot(uint32_t seq, NotifSlot& out){
+  if(!f || !f.seek((seq % NOTIF_SLOTS)*sizeof(NotifSlot))) return false;
+  if(f.read((uint8_t*)&out,sizeof(out))!=sizeof(out)) return false;
+  return slotValid(out) && out.seq==seq && out.len!=NOTIF_CLEARED;
+}
+
+size_t NotifLog::read(uint32_t since, NotifSlot* out, size_t max){
+  uint32_t start = first();
+  if(since+1>start) start=since+1;
+  size_t n=0;
+  for(uint32_t seq=start; seq<next && n<max; seq++)
+    if(readSlot(seq,out[n])) n++;
+  return n;
+}
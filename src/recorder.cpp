@@ -0,0 +1,41 @@
+#include "recorder.h"
+#include "control.h"
+#include "demand.h"
+#include "hal.h"
+
+TsStore history;
+DayLog days;
+static Timer flushTimer;
+
+static void onFlush(Timer &){ history.flush(); }
+
+void recorderBegin(int32_t tzOffset){
+  history.begin(tzOffset);
+  flushTimer.fn = onFlush;
+  flushTimer.periodMs = TS_FLUSH_MS;
+  timers.arm(flushTimer, TS_FLUSH_MS);
+}
+
+void recordHistory(uint32_t tnow, const Readings &s){
+  static bool primed=false;
+  static int64_t lastUWh[NUM_LOADS];
+  static unsigned long lastOn[NUM_LOADS];
+  static uint16_t lastClosed=0;
+  if(s.closed.day!=lastClosed){
+    lastClosed=s.closed.day;
+    const DemandDay *peaks = demand.closed.day==s.closed.day ? &demand.closed : nullptr;
+    if(!days.write(s.closed, peaks)) hal::logf("Day %u not written to the ledger", (unsigned)s.closed.day);
+  }
+  TsSample ts[NUM_LOADS];
+  for(int i=0;i<NUM_LOADS;i++){
+    const Reading &r=s.r[i];
+    if(!primed){ lastUWh[i]=r.uWh; lastOn[i]=r.onSecondsToday; }
+    if(r.onSecondsToday<lastOn[i]) lastOn[i]=0;   // restarted at midnight
+    ts[i].uWh=(uint32_t)(r.uWh-lastUWh[i]); ts[i].onSec=r.onSecondsToday-lastOn[i];
+    ts[i].pMean=r.w.p.mean; ts[i].pMax=r.w.p.max; ts[i].relay=L[i].relay;
+    lastUWh[i]=r.uWh; lastOn[i]=r.onSecondsToday;
+  }
+  primed=true;
+  if(tnow<EPOCH_VALID) return;
+  history.ingest(tnow, ts);
+}
@@ -0,0 +1,99 @@
+#include "sampler.h"
+#include "control.h"
+#include "hal.h"
+#include "metrics.h"
+
+Snapshot<Readings> readings;
+Channel CH[NUM_LOADS];
+Sampler sampler;
+volatile uint16_t sampleHz = SAMPLE_HZ_DEFAULT;
+volatile uint32_t priceMilli = 8000;
+
+void Sampler::begin(){
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    present[i] = hal::initSensor(i);
+    hal::logf("INA %d %s", i+1, present[i] ? "found" : "NOT found");
+  }
+  windowStart = hal::millis();
+  lastUs = hal::micros();
+  reprice(windowStart);
+}
+
+void Sampler::restore(const Readings &saved){
+  acc.day = saved.day;
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    const Reading &r = saved.r[i];
+    CH[i].energy.uWh = r.uWh;
+    CH[i].energy.costMilli = r.costMilli;
+    dayUWh[i] = r.uWh-r.uWhToday;
+    dayCost[i] = r.costMilli-r.costToday;
+    onUs[i] = (uint64_t)r.onSecondsToday*1000000;
+    acc.r[i].uWh = r.uWh;
+    acc.r[i].costMilli = r.costMilli;
+    acc.r[i].uWhToday = r.uWhToday;
+    acc.r[i].costToday = r.costToday;
+    acc.r[i].onSecondsToday = r.onSecondsToday;
+  }
+  readings.publish(acc);
+}
+
+// Counters of a day never seen (first boot, or before the first clock
+// sync) are adopted as today's rather than closed out.
+void Sampler::rollover(uint16_t today){
+  if(acc.day){
+    DayTotals &d = acc.closed;
+    d.day = acc.day;
+    for(uint8_t i=0;i<NUM_LOADS;i++){
+      d.onSec[i] = onUs[i]/1000000;
+      d.uWh[i] = CH[i].energy.uWh-dayUWh[i];
+      d.costMilli[i] = CH[i].energy.costMilli-dayCost[i];
+      dayUWh[i] = CH[i].energy.uWh;
+      dayCost[i] = CH[i].energy.costMilli;
+      onUs[i] = 0;
+    }
+  }
+  acc.day = today;
+}
+
+void Sampler::reprice(uint32_t nowMs){
+  uint32_t holdSec;
+  touActive = tariff.latest().rateAt(hal::epoch(), tzOffset, touRate, holdSec);
+  touUntilMs = nowMs + holdSec*1000;
+  reprices++;
+}
+
+void Sampler::sample(){
+  uint32_t now = hal::millis();
+  if(tariff.take() || (int32_t)(now-touUntilMs) >= 0) reprice(now);
+  uint32_t price = touActive ? touRate : priceMilli;
+  rateMilli = price;
+  uint32_t tUs = hal::micros();
+  uint32_t elapsedUs = tUs - lastUs;
+  lastUs = tUs;
+  uint32_t c0 = hal::cycles();
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    if(L[i].relay) onUs[i] += elapsedUs;
+    float v, c;
+    if(!present[i] || !hal::readSensor(i, v, c)) continue;
+    if(c<0) c=0;
+    CH[i].add(hal::micros(), v, c, price);
+  }
+  phaseDone(PH_INA, c0);
+
+  now = hal::millis();
+  bootMark(bootTimes.firstSample, now);
+  if(now-windowStart < WINDOW_MS) return;
+  windowStart = (now-windowStart < 2*WINDOW_MS) ? windowStart+WINDOW_MS : now;
+  uint16_t today = localDay(hal::epoch(), tzOffset);
+  if(today && today!=acc.day) rollover(today);
+  for(uint8_t i=0;i<NUM_LOADS;i++){
+    Reading &r = acc.r[i];
+    r.w = CH[i].closeWindow();
+    r.uWh = CH[i].energy.uWh;
+    r.costMilli = CH[i].energy.costMilli;
+    r.uWhToday = r.uWh-dayUWh[i];
+    r.costToday = r.costMilli-dayCost[i];
+    r.onSecondsToday = onUs[i]/1000000;
+  }
+  readings.publish(acc);
+}
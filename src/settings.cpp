@@ -0,0 +1,66 @@
+#include <SPIFFS.h>
+#include <ArduinoJson.h>
+#include <math.h>
+#include "settings.h"
+#include "control.h"
+#include "checkpoint.h"
+#include "demand.h"
+#include "hal.h"
+
+const char* SETTINGS_FILE = "/settings.json";
+Debouncer settingsSave(1500, 10000);
+
+void saveSettingsToFS(){
+  StaticJsonDocument<1024> doc;
+  doc["unitPrice"] = priceMilli/1000.0;
+  doc["sampleHz"] = sampleHz;
+  doc["checkpointSec"] = checkpointSec;
+  doc["demandMin"] = demandWindowMin;
+  doc["demandLimitW"] = demandLimitW;
+  JsonArray loads = doc.createNestedArray("loads");
+  for(int i=0;i<NUM_LOADS;i++){
+    JsonObject o = loads.createNestedObject();
+    o["limitSec"] = L[i].usageLimitSeconds;
+    o["timerMin"] = L[i].timerMinutes;
+    o["onAt"] = L[i].onAt;
+    o["offAt"] = L[i].offAt;
+    o["shed"] = L[i].shed;
+  }
+  File f = SPIFFS.open(SETTINGS_FILE, FILE_WRITE);
+  if(f){ serializeJson(doc,f); f.close(); }
+  else hal::logf("Failed to open settings file for writing");
+}
+
+void markSettingsDirty(){ settingsSave.touch(hal::millis()); }
+
+bool flushSettingsIfDue(){
+  if(!settingsSave.due(hal::millis())) return false;
+  saveSettingsToFS();
+  settingsSave.done();
+  return true;
+}
+
+void loadSettingsFromFS(){
+  if(!SPIFFS.exists(SETTINGS_FILE)){ saveSettingsToFS(); return; }
+  File f = SPIFFS.open(SETTINGS_FILE, FILE_READ);
+  if(!f){ hal::logf("Failed to open settings"); return; }
+  StaticJsonDocument<1024> doc;
+  DeserializationError err = deserializeJson(doc,f);
+  f.close();
+  if(err){ hal::logf("Settings JSON parse fail"); return; }
+  double price = doc["unitPrice"] | -1.0;
+  if(validPrice(price)) priceMilli = lround(price*1000.0);
+  if(doc.containsKey("sampleHz")) sampleHz = clampSampleHz(doc["sampleHz"].as<int>());
+  if(doc.containsKey("checkpointSec")) checkpointSec = clampCheckpointSec(doc["checkpointSec"].as<long>());
+  if(doc.containsKey("demandMin")) demandWindowMin = clampDemandWindow(doc["demandMin"].as<int>());
+  if(doc.containsKey("demandLimitW")) demandLimitW = doc["demandLimitW"].as<unsigned long>();
+  if(doc.containsKey("loads")){
+    JsonArray arr = doc["loads"].as<JsonArray>();
+    for(int i=0;i<NUM_LOADS && i<(int)arr.size();i++){
+      if(arr[i].containsKey("limitSec")) L[i].usageLimitSeconds = arr[i]["limitSec"].as<unsigned long>();
+      if(arr[i].containsKey("timerMin")) L[i].timerMinutes = arr[i]["timerMin"].as<int>();
+      setSchedule(i, arr[i]["onAt"]|-1L, arr[i]["offAt"]|-1L);
+      L[i].shed = arr[i]["shed"]|0;
+    }
+  }
+}
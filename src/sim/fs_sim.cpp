@@ -0,0 +1,63 @@
+#include <SPIFFS.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+
+SPIFFSFS SPIFFS;
+
+static std::string root(){
+  const char* r = getenv("SIM_FS");
+  return r && *r ? r : ".simfs";
+}
+
+static std::string hostPath(const char* path){ return root() + path; }
+
+// SPIFFS paths are flat names that may contain '/'; make the directories.
+static void makeParents(const std::string &p){
+  for(size_t k=p.find('/',1); k!=std::string::npos; k=p.find('/',k+1))
+    mkdir(p.substr(0,k).c_str(), 0755);
+}
+
+namespace fs {
+
+size_t File::size() const {
+  if(!fp) return 0;
+  long at = ftell(fp.get());
+  fseek(fp.get(), 0, SEEK_END);
+  long n = ftell(fp.get());
+  fseek(fp.get(), at, SEEK_SET);
+  return (size_t)n;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode){
+  if(!fp) return false;
+  int whence = mode==SeekSet ? SEEK_SET : mode==SeekCur ? SEEK_CUR : SEEK_END;
+  return fseek(fp.get(), (long)pos, whence)==0;
+}
+
+File FS::open(const char* path, const char* mode, bool){
+  std::string p = hostPath(path);
+  if(mode[0]!='r') makeParents(p);
+  // "r+" is the only update mode the firmware uses; binary everywhere.
+  std::string m = std::string(mode[0]=='r' && mode[1]=='+' ? "r+" : std::string(1,mode[0])) + "b";
+  return File(fopen(p.c_str(), m.c_str()));
+}
+
+bool FS::exists(const char* path){
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st)==0;
+}
+
+bool FS::remove(const char* path){ return ::remove(hostPath(path).c_str())==0; }
+
+bool FS::rename(const char* from, const char* to){
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str())==0;
+}
+
+}
+
+bool SPIFFSFS::begin(bool){
+  std::string r = root();
+  makeParents(r + "/");
+  return mkdir(r.c_str(), 0755)==0 || exists("");
+}
@@ -0,0 +1,92 @@
+#include "hal.h"
+#include "sim.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+struct SimLoad {
+  float volts=12.0f, amps=0, ripple=0;
+  float readV=0, readA=0;   // last readSensor() result
+  bool relay=false;
+  uint32_t switches=0;
+};
+
+static SimLoad loads[4];
+static uint64_t clockUs = 0;
+static uint32_t epoch0 = 0;
+static uint32_t noise = 1;
+static bool logging = true;
+static uint8_t rtcMem[hal::RTC_BYTES];   // zeroed, like RTC memory after power-on fails validation
+
+// Cheap deterministic noise in [-1,1], so runs are repeatable.
+static float jitter(){
+  noise = noise*1664525u + 1013904223u;
+  return (int32_t)noise / 2147483648.0f;
+}
+
+namespace sim {
+
+void setLoad(uint8_t i, float volts, float amps, float ripple){
+  loads[i].volts=volts; loads[i].amps=amps; loads[i].ripple=ripple;
+}
+void setEpoch(uint32_t epoch){ epoch0=epoch; }
+void advance(uint32_t us){ clockUs += us; }
+uint64_t nowUs(){ return clockUs; }
+void setLogging(bool on){ logging=on; }
+bool relay(uint8_t i){ return loads[i].relay; }
+uint32_t relaySwitches(uint8_t i){ return loads[i].switches; }
+void lastRead(uint8_t i, float &volts, float &amps){ volts=loads[i].readV; amps=loads[i].readA; }
+
+}
+
+namespace hal {
+
+uint32_t millis(){ return (uint32_t)(clockUs/1000); }
+uint32_t micros(){ return (uint32_t)clockUs; }
+uint32_t epoch(){ return epoch0 + (uint32_t)(clockUs/1000000); }
+// Host time, not virtual: the cycle counter measures what the code costs.
+uint32_t cycles(){
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+uint32_t cyclesPerUs(){ return 1000; }
+
+void initRelays(){
+  for(int i=0;i<4;i++) loads[i].relay=false;
+}
+
+void setRelay(uint8_t i, bool on){
+  if(loads[i].relay!=on) loads[i].switches++;
+  loads[i].relay=on;
+}
+
+bool initSensor(uint8_t){ return true; }
+
+bool readSensor(uint8_t i, float &volts, float &amps){
+  SimLoad &l = loads[i];
+  volts = l.readV = l.volts;
+  amps = l.readA = l.relay ? l.amps*(1+l.ripple*jitter()) : 0;
+  return true;
+}
+
+bool rtcLoad(void* out, size_t n){
+  if(n>sizeof(rtcMem)) return false;
+  memcpy(out, rtcMem, n);
+  return true;
+}
+
+void rtcStore(const void* in, size_t n){
+  if(n<=sizeof(rtcMem)) memcpy(rtcMem, in, n);
+}
+
+void logf(const char* fmt, ...){
+  if(!logging) return;
+  va_list ap;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  putchar('\n');
+}
+
+}
@@ -0,0 +1,211 @@
+// Trace replay: drives the sampler, usage limits, timers and history store
+// from a recorded V/I trace (see trace.h) on a virtual clock, as fast as the
+// CPU allows, and checks the integer energy integration against a double
+// precision reference over the same samples.
+//
+//   pio run -e replay
+//   .pio/build/replay/program [options] <trace.csv|trace.ptr>
+//     --on 1,2,3      loads switched ON at the start (default all)
+//     --limit 2:3600  usage limit, seconds      --timer 3:30  timer, minutes
+//     --price 8.5     unit price per kWh        --no-history  skip the store
+//     --tariff t.json time-of-use schedule (see tariff.h)
+//     --quiet         no per-notification lines --to-bin out.ptr  convert only
+#include <SPIFFS.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "hal.h"
+#include "sim.h"
+#include "trace.h"
+#include "sampler.h"
+#include "control.h"
+#include "recorder.h"
+#include "demand.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t HOLD_US = 1000000;   // longest step between samples fed to the meter
+
+bool quiet = false;
+uint32_t notifCount = 0;
+
+void pushNotification(const char* text){
+  notifCount++;
+  if(quiet) return;
+  printf("[%10lu] %s\n", (unsigned long)hal::epoch(), text);
+}
+
+struct Reference {
+  bool primed = false;
+  uint64_t lastUs = 0;
+  double lastW[NUM_LOADS] = {0,0,0,0};
+  double wh[NUM_LOADS] = {0,0,0,0};
+
+  // Trapezoid over exactly the samples the meter read; relay OFF reads 0 A.
+  void add(uint64_t tUs){
+    for(int i=0;i<NUM_LOADS;i++){
+      float v, a;
+      sim::lastRead(i, v, a);
+      double w = v*(a<0 ? 0 : a);
+      if(primed) wh[i] += (lastW[i]+w)/2*(tUs-lastUs)/3.6e9;
+      lastW[i] = w;
+    }
+    lastUs = tUs;
+    primed = true;
+  }
+};
+
+static double secs(Clock::duration d){ return std::chrono::duration<double>(d).count(); }
+
+static bool loadArg(const char* s, int &load, double &value){
+  char* end;
+  load = strtol(s,&end,10);
+  if(*end!=':' || load<1 || load>NUM_LOADS) return false;
+  value = strtod(end+1,nullptr);
+  load--;
+  return true;
+}
+
+int main(int argc, char** argv){
+  const char* path = nullptr;
+  const char* toBin = nullptr;
+  const char* on = "1,2,3,4";
+  bool useHistory = true;
+  int limits[NUM_LOADS], timerMin[NUM_LOADS];
+  for(int i=0;i<NUM_LOADS;i++){ limits[i]=-1; timerMin[i]=-1; }
+  double price = -1;
+  const char* tariffPath = nullptr;
+
+  for(int k=1;k<argc;k++){
+    const char* a = argv[k];
+    const char* v = k+1<argc ? argv[k+1] : nullptr;
+    int load; double x;
+    if(!strcmp(a,"--quiet")) quiet = true;
+    else if(!strcmp(a,"--no-history")) useHistory = false;
+    else if(!strcmp(a,"--on") && v){ on = v; k++; }
+    else if(!strcmp(a,"--price") && v){ price = atof(v); k++; }
+    else if(!strcmp(a,"--tariff") && v){ tariffPath = v; k++; }
+    else if(!strcmp(a,"--to-bin") && v){ toBin = v; k++; }
+    else if(!strcmp(a,"--limit") && v && loadArg(v,load,x)){ limits[load] = (int)x; k++; }
+    else if(!strcmp(a,"--timer") && v && loadArg(v,load,x)){ timerMin[load] = (int)x; k++; }
+    else if(a[0]!='-' && !path) path = a;
+    else { fprintf(stderr,"bad argument: %s\n",a); return 2; }
+  }
+  if(!path){ fprintf(stderr,"usage: %s [options] <trace.csv|trace.ptr>\n",argv[0]); return 2; }
+
+  if(tariffPath){
+    char buf[1024];
+    FILE* f = fopen(tariffPath,"rb");
+    size_t n = f ? fread(buf,1,sizeof(buf),f) : 0;
+    if(f) fclose(f);
+    TariffTable t;
+    const char* err = f ? compileTariff(buf,n,t) : "cannot open";
+    if(err){ fprintf(stderr,"%s: %s\n",tariffPath,err); return 2; }
+    tariff.post(t);
+  }
+
+  TraceReader trace;
+  if(!trace.open(path)){ fprintf(stderr,"cannot open %s\n",path); return 1; }
+  if(toBin){
+    if(!trace.writeBinary(toBin)){ fprintf(stderr,"cannot write %s\n",toBin); return 1; }
+    printf("%llu lines, %llu skipped -> %s\n",(unsigned long long)trace.lines,(unsigned long long)trace.bad,toBin);
+    return 0;
+  }
+
+  TraceRow row;
+  bool have = trace.next(row);
+  sim::setEpoch(trace.epoch0 ? trace.epoch0 : sim::DEFAULT_EPOCH);
+  hal::initRelays();
+  controlBegin();
+  if(useHistory){
+    if(!SPIFFS.begin(true)) hal::logf("FS root unavailable");
+    recorderBegin(sim::TZ_OFFSET);
+    if(!days.begin("/days.log")) hal::logf("Daily ledger unavailable");
+  }
+  sampler.tzOffset = sim::TZ_OFFSET;
+  sampler.begin();
+  if(price>=0) priceMilli = lround(price*1000);
+  for(int i=0;i<NUM_LOADS;i++){
+    if(limits[i]>=0) setLimit(i, limits[i]);
+    if(timerMin[i]>=0) setTimer(i, timerMin[i], hal::epoch());
+  }
+  for(const char* p=on; *p; p++) if(*p>='1' && *p<'1'+NUM_LOADS) relayCommand(*p-'1', true, hal::epoch());
+
+  Reference ref;
+  Clock::duration tRead{}, tSample{}, tTick{};
+  uint64_t samples = 0, held = 0;
+  uint32_t lastSec = hal::epoch();
+  Clock::time_point wall0 = Clock::now(), t0 = wall0;
+
+  // Timers due by the current clock (a relay switched in a gap is switched
+  // for the sample that ends it), one meter sample, then the 1 s tick if a
+  // new second began.
+  auto step = [&](){
+    Clock::time_point a = Clock::now();
+    timers.advance(hal::millis());
+    sampler.sample();
+    ref.add(sim::nowUs());
+    samples++;
+    Clock::time_point b = Clock::now();
+    tSample += b-a;
+    uint32_t t = hal::epoch();
+    if(t==lastSec) return;
+    lastSec = t;
+    Readings s = readings.read();
+    controlTick(t);
+    if(demand.tick(t, s)) demandControl(demand);
+    if(useHistory) recordHistory(t, s);
+    tTick += Clock::now()-b;
+  };
+
+  while(have){
+    Clock::time_point a = Clock::now();
+    tRead += a-t0;
+    if(row.cmd){
+      uint32_t e = hal::epoch();
+      switch(row.cmd){
+        case CMD_RELAY: relayCommand(row.load, row.value!=0, e); break;
+        case CMD_TIMER: setTimer(row.load, (int)row.value, e); break;
+        case CMD_LIMIT: setLimit(row.load, (unsigned long)row.value); break;
+        case CMD_PRICE: priceMilli = lround(row.value*1000); break;
+        default: break;
+      }
+    } else {
+      // Across a gap the last reading is held, so ticks and timers still run.
+      while(row.tUs > sim::nowUs()+HOLD_US){ sim::advance(HOLD_US); step(); held++; }
+      sim::advance((uint32_t)(row.tUs-sim::nowUs()));
+      for(int i=0;i<NUM_LOADS;i++) sim::setLoad(i, row.v[i], row.i[i]);
+      step();
+    }
+    t0 = Clock::now();
+    have = trace.next(row);
+  }
+  tRead += Clock::now()-t0;
+  if(useHistory) history.flush();
+  double wall = secs(Clock::now()-wall0);
+  double span = sim::nowUs()/1e6;
+
+  Readings s = readings.read();
+  printf("\n%s: %llu lines (%llu skipped), %.0f s of trace, %llu samples (%llu held)\n", path,
+         (unsigned long long)trace.lines, (unsigned long long)trace.bad, span,
+         (unsigned long long)samples, (unsigned long long)held);
+  printf("%.3f s wall, %.0fx real time, %.1f ns/sample\n", wall, wall>0 ? span/wall : 0,
+         samples ? wall*1e9/samples : 0);
+  printf("  read %.3f s  sample %.3f s  tick %.3f s\n", secs(tRead), secs(tSample), secs(tTick));
+  for(int i=0;i<NUM_LOADS;i++){
+    const Reading &r = s.r[i];
+    double wh = CH[i].energy.uWh/1e6;   // readings lag by up to a window
+    double ppm = ref.wh[i]>0 ? (wh-ref.wh[i])/ref.wh[i]*1e6 : 0;
+    printf("load %d: %12.4f Wh (ref %12.4f, %+7.1f ppm)  cost %9.3f  on today %8lu s  switches %lu  relay %s\n",
+           i+1, wh, ref.wh[i], ppm, CH[i].energy.costMilli/1000.0, r.onSecondsToday,
+           (unsigned long)sim::relaySwitches(i), sim::relay(i) ? "ON" : "OFF");
+  }
+  printf("notifications %lu", (unsigned long)notifCount);
+  if(useHistory) printf(", history page writes %lu, days closed %lu", (unsigned long)history.pageWrites, (unsigned long)days.writes);
+  printf("\n");
+  printf("demand %.3f W over %u min, peak %.3f W\n", demand.demandMw[DEMAND_TOTAL]/1000.0,
+         (unsigned)demand.windowMin(), demand.month[DEMAND_TOTAL].mW/1000.0);
+  return 0;
+}
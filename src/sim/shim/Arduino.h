@@ -0,0 +1,35 @@
+#pragma once
+// Host stand-in for the bits of Arduino.h the portable sources use: String,
+// with just the members ArduinoJson and the firmware core call. The native
+// envs build with ARDUINOJSON_ENABLE_ARDUINO_STRING=1 so it serializes into
+// this like it does on the board.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+class String {
+public:
+  String() {}
+  String(const char* s) : s(s ? s : "") {}
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return (unsigned int)s.size(); }
+  bool reserve(unsigned int n){ s.reserve(n); return true; }
+  bool concat(const char* x){ s += x; return true; }
+  bool concat(char c){ s += c; return true; }
+  String& operator+=(const char* x){ s += x; return *this; }
+  String& operator+=(char c){ s += c; return *this; }
+  char operator[](unsigned int i) const { return s[i]; }
+  bool operator==(const String &o) const { return s==o.s; }
+
+private:
+  std::string s;
+};
+
+// What String + String yields on Arduino. ArduinoJson names it when it
+// adapts Arduino strings, so it has to exist.
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String &s) : String(s) {}
+  StringSumHelper(const char* p) : String(p) {}
+};
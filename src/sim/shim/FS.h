@@ -0,0 +1,57 @@
+#pragma once
+// Host stand-in for the Arduino-ESP32 FS API, used by the native env only.
+// Files live under a host directory (SIM_FS, default ".simfs"), so a run's
+// store and settings survive into the next one like SPIFFS does.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <memory>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+class File {
+public:
+  File() {}
+  explicit File(FILE* f){ if(f) fp.reset(f, fclose); }
+
+  explicit operator bool() const { return (bool)fp; }
+  void close(){ fp.reset(); }
+
+  size_t size() const;
+  size_t position() const { return fp ? (size_t)ftell(fp.get()) : 0; }
+  bool seek(uint32_t pos, SeekMode mode=SeekSet);
+  int available(){ return fp ? (int)(size()-position()) : 0; }
+
+  size_t read(uint8_t* buf, size_t n){ return fp ? fread(buf,1,n,fp.get()) : 0; }
+  int read(){ uint8_t c; return read(&c,1) ? c : -1; }
+  size_t readBytes(char* buf, size_t n){ return read((uint8_t*)buf,n); }
+  size_t write(const uint8_t* buf, size_t n){ return fp ? fwrite(buf,1,n,fp.get()) : 0; }
+  size_t write(uint8_t c){ return write(&c,1); }
+  void flush(){ if(fp) fflush(fp.get()); }
+
+private:
+  std::shared_ptr<FILE> fp;
+};
+
+class FS {
+public:
+  File open(const char* path, const char* mode=FILE_READ, bool create=false);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+};
+
+}
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
@@ -0,0 +1,9 @@
+#pragma once
+#include "FS.h"
+
+class SPIFFSFS : public fs::FS {
+public:
+  bool begin(bool formatOnFail=false);
+};
+
+extern SPIFFSFS SPIFFS;
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+// ---------------- Simulated board ----------------
+// Control side of src/sim/hal_sim.cpp: the simulator sets what each load
+// draws and moves a virtual clock; the HAL reports it to the firmware core.
+namespace sim {
+  const uint32_t DEFAULT_EPOCH = 1700000000;  // any synced wall clock will do
+  const long TZ_OFFSET = 19800;               // same as the firmware's gmtOffset_sec
+
+  // What load i draws while its relay is ON; ripple is a +/- fraction of amps.
+  void setLoad(uint8_t i, float volts, float amps, float ripple=0);
+  void setEpoch(uint32_t epoch);   // wall clock at virtual time 0
+  void advance(uint32_t us);
+  uint64_t nowUs();
+
+  void setLogging(bool on);        // hal::logf output, on by default
+
+  bool relay(uint8_t i);
+  uint32_t relaySwitches(uint8_t i);
+  // What the sensor last returned to the meter, for checking against it.
+  void lastRead(uint8_t i, float &volts, float &amps);
+}
@@ -0,0 +1,90 @@
+// Native simulator: runs the sampler, relay control, settings and history
+// store against a simulated board on a virtual clock, far faster than real
+// time. Usage: pio run -e native && .pio/build/native/program [seconds] [hz]
+//
+// Left out of the unit-test builds (pio test -e native), which bring their
+// own main() and notification hook.
+#ifndef PIO_UNIT_TESTING
+#include <SPIFFS.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "hal.h"
+#include "sim.h"
+#include "sampler.h"
+#include "control.h"
+#include "settings.h"
+#include "recorder.h"
+#include "demand.h"
+
+uint32_t notifCount = 0;
+
+void pushNotification(const char* text){
+  notifCount++;
+  printf("[%7lu s] %s\n", (unsigned long)(sim::nowUs()/1000000), text);
+}
+
+int main(int argc, char** argv){
+  uint32_t seconds = argc>1 ? strtoul(argv[1],nullptr,10) : 7200;
+  sim::setEpoch(sim::DEFAULT_EPOCH);
+  sim::setLoad(0, 12.0f, 0.50f, 0.02f);  // 6 W, always on
+  sim::setLoad(1, 12.0f, 1.25f, 0.05f);  // 15 W, stopped by a 1 h usage limit
+  sim::setLoad(2, 5.0f, 2.00f, 0.10f);   // 10 W, stopped by a 30 min timer
+  sim::setLoad(3, 12.0f, 0.10f, 0.00f);  // left OFF
+
+  if(!SPIFFS.begin(true)) hal::logf("FS root unavailable");
+  hal::initRelays();
+  controlBegin();
+  recorderBegin(sim::TZ_OFFSET);
+  if(!days.begin("/days.log")) hal::logf("Daily ledger unavailable");
+  sampler.tzOffset = sim::TZ_OFFSET;
+  sampler.begin();
+  loadSettingsFromFS();
+  if(argc>2) sampleHz = clampSampleHz(atoi(argv[2]));
+
+  setLimit(1, 3600);
+  setTimer(2, 30, hal::epoch());
+  markSettingsDirty();
+  relayCommand(0, true, hal::epoch());
+  relayCommand(1, true, hal::epoch());
+  relayCommand(2, true, hal::epoch());
+
+  auto wall0 = std::chrono::steady_clock::now();
+  uint64_t endUs = (uint64_t)seconds*1000000;
+  uint32_t lastSec = hal::epoch();
+  uint64_t samples = 0;
+  while(sim::nowUs() < endUs){
+    sim::advance(1000000/sampleHz);
+    sampler.sample();
+    timers.advance(hal::millis());
+    samples++;
+    flushSettingsIfDue();
+    uint32_t t = hal::epoch();
+    if(t==lastSec) continue;
+    lastSec = t;
+    Readings s = readings.read();
+    controlTick(t);
+    if(demand.tick(t, s)) demandControl(demand);
+    recordHistory(t, s);
+  }
+  history.flush();
+  if(settingsSave.pending()){ saveSettingsToFS(); settingsSave.done(); }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now()-wall0).count();
+
+  Readings s = readings.read();
+  printf("\n%lu s simulated at %u Hz, %llu samples, %.3f s wall (%.0fx real time)\n",
+         (unsigned long)seconds, (unsigned)sampleHz, (unsigned long long)samples, wall, wall>0 ? seconds/wall : 0);
+  for(int i=0;i<NUM_LOADS;i++){
+    const Reading &r = s.r[i];
+    printf("load %d: %10.4f Wh  cost %8.3f  on %6lu s  switches %lu  relay %s\n", i+1,
+           r.uWh/1e6, r.costMilli/1000.0, r.onSecondsToday, (unsigned long)sim::relaySwitches(i),
+           sim::relay(i) ? "ON" : "OFF");
+  }
+  printf("notifications %lu, settings writes %lu (coalesced %lu), history page writes %lu\n",
+         (unsigned long)notifCount, (unsigned long)settingsSave.writes,
+         (unsigned long)settingsSave.coalesced, (unsigned long)history.pageWrites);
+  printf("demand %.3f W over %u min, peak %.3f W\n", demand.demandMw[DEMAND_TOTAL]/1000.0,
+         (unsigned)demand.windowMin(), demand.month[DEMAND_TOTAL].mW/1000.0);
+  return 0;
+}
+#endif
@@ -0,0 +1,129 @@
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char BIN_MAGIC[4] = {'P','T','R','1'};
+static const uint32_t BIN_CMD = 0xFFFFFFFF;
+
+TraceReader::~TraceReader(){ if(f) fclose(f); }
+
+bool TraceReader::open(const char* path){
+  f = fopen(path, "rb");
+  if(!f) return false;
+  static char buf[1<<16];
+  setvbuf(f, buf, _IOFBF, sizeof(buf));
+  char magic[4];
+  if(fread(magic,1,4,f)==4 && memcmp(magic,BIN_MAGIC,4)==0){
+    uint32_t h[3];
+    if(fread(h,4,3,f)!=3) return false;
+    binary = true;
+    epoch0 = h[0];
+    return true;
+  }
+  rewind(f);
+  return true;
+}
+
+bool TraceReader::next(TraceRow &row){
+  return binary ? nextBin(row) : nextCsv(row);
+}
+
+bool TraceReader::nextBin(TraceRow &row){
+  struct { uint32_t dtUs; float v[4], i[4]; } rec;
+  if(fread(&rec,sizeof(rec),1,f)!=1) return false;
+  lines++;
+  memset(&row,0,sizeof(row));
+  if(rec.dtUs==BIN_CMD){
+    row.tUs = lastUs;
+    row.cmd = (TraceCmd)(uint8_t)rec.v[0];
+    row.load = (uint8_t)rec.v[1];
+    row.value = rec.i[0];
+    return true;
+  }
+  lastUs += rec.dtUs;
+  row.tUs = lastUs;
+  memcpy(row.v,rec.v,sizeof(row.v));
+  memcpy(row.i,rec.i,sizeof(row.i));
+  return true;
+}
+
+bool TraceReader::nextCsv(TraceRow &row){
+  char line[256];
+  while(fgets(line,sizeof(line),f)){
+    lines++;
+    char* p = line;
+    memset(&row,0,sizeof(row));
+    if(*p=='!'){
+      char name[16]; double a=0, b=0;
+      int got = sscanf(p+1,"%15s %lf %lf",name,&a,&b);
+      row.tUs = lastUs;
+      if(got>=2 && !strcmp(name,"price")){ row.cmd=CMD_PRICE; row.value=a; return true; }
+      if(got==3 && a>=1 && a<=4){
+        row.load = (uint8_t)a-1; row.value = b;
+        if(!strcmp(name,"relay")) row.cmd=CMD_RELAY;
+        else if(!strcmp(name,"timer")) row.cmd=CMD_TIMER;
+        else if(!strcmp(name,"limit")) row.cmd=CMD_LIMIT;
+        if(row.cmd) return true;
+      }
+      bad++;
+      continue;
+    }
+    if(*p=='#' || *p=='\n' || *p=='\r' || (*p>='A' && *p<='z')) continue;
+
+    char* end;
+    double t = strtod(p,&end);
+    if(end==p){ bad++; continue; }
+    for(int k=0;k<8 && *end==',';k++){
+      p = end+1;
+      float x = strtof(p,&end);
+      if(k&1) row.i[k/2]=x; else row.v[k/2]=x;
+    }
+    if(!started){
+      started = true;
+      // Seconds since 2001 or later read as a wall clock.
+      if(t>=1e9){ epoch0=(uint32_t)t; t0=epoch0; }
+    }
+    double us = (t-t0)*1e6;
+    row.tUs = us>0 ? (uint64_t)(us+0.5) : 0;
+    if(row.tUs<lastUs){ bad++; continue; }   // out of order
+    lastUs = row.tUs;
+    return true;
+  }
+  return false;
+}
+
+bool TraceReader::writeBinary(const char* path){
+  FILE* o = fopen(path,"wb");
+  if(!o) return false;
+  TraceRow row, last;
+  memset(&last,0,sizeof(last));
+  bool head = false;
+  while(next(row)){
+    if(!head){
+      uint32_t h[3] = {epoch0, 0, 0};
+      fwrite(BIN_MAGIC,1,4,o); fwrite(h,4,3,o);
+      head = true;
+    }
+    struct { uint32_t dtUs; float v[4], i[4]; } rec;
+    memset(&rec,0,sizeof(rec));
+    if(row.cmd){
+      rec.dtUs = BIN_CMD;
+      rec.v[0] = row.cmd; rec.v[1] = row.load; rec.i[0] = (float)row.value;
+    } else {
+      uint64_t dt = row.tUs-last.tUs;
+      // A gap past ~71 min does not fit dtUs; hold the previous sample across it.
+      memcpy(rec.v,last.v,sizeof(rec.v)); memcpy(rec.i,last.i,sizeof(rec.i));
+      while(dt>=BIN_CMD){
+        rec.dtUs = BIN_CMD-1;
+        fwrite(&rec,sizeof(rec),1,o);
+        dt -= BIN_CMD-1;
+      }
+      rec.dtUs = (uint32_t)dt;
+      memcpy(rec.v,row.v,sizeof(rec.v)); memcpy(rec.i,row.i,sizeof(rec.i));
+      last = row;
+    }
+    fwrite(&rec,sizeof(rec),1,o);
+  }
+  if(!head){ uint32_t h[3] = {epoch0,0,0}; fwrite(BIN_MAGIC,1,4,o); fwrite(h,4,3,o); }
+  return fclose(o)==0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+// ---------------- Recorded traces ----------------
+// Field captures of V/I for the replay tool, in one of two formats.
+//
+// CSV, one sample per line; loads not captured may be left off the end:
+//   t,v1,i1,v2,i2,v3,i3,v4,i4      t in seconds (epoch, or from 0), V, A
+// plus optional command lines, applied at the time of the previous sample:
+//   !relay <load> <0|1>   !timer <load> <minutes>   !limit <load> <seconds>
+//   !price <per kWh>
+// Lines starting with '#' or a letter (a header) are skipped.
+//
+// Binary (.ptr), little-endian, about 10x cheaper to parse than CSV:
+//   header  16 B  "PTR1", u32 epoch at t=0 (0 if relative), u32 reserved[2]
+//   record  36 B  u32 dtUs since the previous record, f32 v[4], f32 i[4]
+// dtUs = 0xFFFFFFFF marks a command record: v[0] = TraceCmd, v[1] = load,
+// i[0] = value.
+
+enum TraceCmd : uint8_t { CMD_NONE, CMD_RELAY, CMD_TIMER, CMD_LIMIT, CMD_PRICE };
+
+struct TraceRow {
+  uint64_t tUs;        // from the first sample
+  float v[4], i[4];
+  TraceCmd cmd;        // CMD_NONE for a sample
+  uint8_t load;        // 0-based
+  double value;
+};
+
+class TraceReader {
+public:
+  ~TraceReader();
+  bool open(const char* path);   // format from the first bytes
+  bool next(TraceRow &row);
+  uint32_t epoch0 = 0;           // wall clock of the first sample, 0 if relative
+  uint64_t lines = 0, bad = 0;
+  bool binary = false;
+
+  // Converts whatever open() accepted into the binary format.
+  bool writeBinary(const char* path);
+
+private:
+  bool nextCsv(TraceRow &row);
+  bool nextBin(TraceRow &row);
+  FILE* f = nullptr;
+  bool started = false;
+  double t0 = 0;
+  uint64_t lastUs = 0;
+};
@@ -0,0 +1,134 @@
+#include <ArduinoJson.h>
+#include <SPIFFS.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tariff.h"
+#include "hal.h"
+#include "sampler.h"
+
+const char* TARIFF_FILE = "/tariff.json";
+Handoff<TariffTable> tariff;
+
+static const size_t TARIFF_JSON_MAX = 1024;
+static const size_t TARIFF_JSON_CAPACITY = JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(TARIFF_RATES) +
+    JSON_ARRAY_SIZE(TARIFF_SEASONS) + TARIFF_SEASONS*JSON_OBJECT_SIZE(3) + TARIFF_JSON_MAX/2;
+
+bool TariffTable::rateAt(uint32_t epoch, int32_t tzOffset, uint32_t &rate, uint32_t &holdSec) const {
+  if(epoch<EPOCH_VALID){ holdSec = 1; return false; }
+  holdSec = TARIFF_RECHECK_SEC;
+  if(!seasons) return false;
+  uint32_t local = epoch+tzOffset;
+  uint32_t days = local/86400, sec = local%86400;
+  uint8_t wd = (days+4)%7;              // 1970-01-01 was a Thursday; 0 = Sunday
+  const uint8_t *day = slot[seasonOfMonth[monthOfDay(days)%12]][wd==0 || wd==6];
+  uint16_t s = sec/TARIFF_SLOT_SEC, e = s+1;
+  while(e<TARIFF_DAY_SLOTS && day[e]==day[s]) e++;
+  // Day type and season only change at midnight, so that bounds the scan.
+  uint32_t left = (uint32_t)e*TARIFF_SLOT_SEC - sec;
+  if(left<holdSec) holdSec = left;
+  rate = rateMilli[day[s]];
+  return true;
+}
+
+// "HH:MM=r HH:MM=r ..." into one day's slots.
+static const char* compileDay(const char* bands, uint8_t rates, uint8_t *day){
+  if(!bands) return "missing bands";
+  uint16_t start[TARIFF_BANDS];
+  uint8_t rate[TARIFF_BANDS];
+  uint8_t n = 0;
+  const char *p = bands;
+  for(;;){
+    while(*p==' ' || *p==',') p++;
+    if(!*p) break;
+    if(n==TARIFF_BANDS) return "too many bands";
+    char *end;
+    unsigned long h = strtoul(p,&end,10);
+    if(end==p || *end!=':') return "bad band time";
+    unsigned long m = strtoul(p=end+1,&end,10);
+    if(end==p || *end!='=' || h>23 || m>59) return "bad band time";
+    unsigned long r = strtoul(p=end+1,&end,10);
+    if(end==p || r>=rates) return "bad band rate";
+    p = end;
+    start[n] = (h*60+m)*60/TARIFF_SLOT_SEC;
+    rate[n] = r;
+    if(n && start[n]<=start[n-1]) return "bands out of order";
+    n++;
+  }
+  if(!n) return "missing bands";
+  uint8_t cur = rate[n-1], k = 0;       // before the first start: the last band
+  for(uint16_t s=0;s<TARIFF_DAY_SLOTS;s++){
+    while(k<n && start[k]<=s) cur = rate[k++];
+    day[s] = cur;
+  }
+  return nullptr;
+}
+
+const char* compileTariff(const char* json, size_t n, TariffTable &out){
+  StaticJsonDocument<TARIFF_JSON_CAPACITY> doc;
+  if(deserializeJson(doc, json, n)) return "invalid JSON";
+  out = TariffTable();
+  JsonArrayConst rates = doc["rates"];
+  JsonArrayConst seasons = doc["seasons"];
+  if(seasons.size()==0) return nullptr;
+  if(rates.size()==0 || rates.size()>TARIFF_RATES) return "need 1 to 8 rates";
+  if(seasons.size()>TARIFF_SEASONS) return "at most 4 seasons";
+  for(size_t k=0;k<rates.size();k++){
+    double r = rates[k] | -1.0;
+    if(!validPrice(r)) return "bad rate";
+    out.rateMilli[k] = lround(r*1000.0);
+  }
+  uint8_t from[TARIFF_SEASONS];
+  for(size_t k=0;k<seasons.size();k++){
+    JsonVariantConst s = seasons[k];
+    int f = s["from"] | 1;
+    if(f<1 || f>12) return "bad season month";
+    from[k] = f;
+    const char *weekday = s["weekday"];
+    const char *weekend = s["weekend"] | weekday;
+    const char *err = compileDay(weekday, rates.size(), out.slot[k][0]);
+    if(!err) err = compileDay(weekend, rates.size(), out.slot[k][1]);
+    if(err) return err;
+  }
+  // Each month belongs to the season with the latest start not after it,
+  // wrapping to the latest start overall.
+  for(uint8_t m=1;m<=12;m++){
+    int best = -1, last = 0;
+    for(uint8_t k=0;k<seasons.size();k++){
+      if(from[k]>from[last]) last = k;
+      if(from[k]<=m && (best<0 || from[k]>from[best])) best = k;
+    }
+    out.seasonOfMonth[m-1] = best<0 ? last : best;
+  }
+  out.seasons = seasons.size();
+  return nullptr;
+}
+
+const char* setTariff(const char* json, size_t n){
+  if(n>=TARIFF_JSON_MAX) return "schedule too long";
+  TariffTable t;
+  const char *err = compileTariff(json, n, t);
+  if(err) return err;
+  if(t.seasons){
+    File f = SPIFFS.open(TARIFF_FILE, FILE_WRITE);
+    if(!f) return "cannot store schedule";
+    f.write((const uint8_t*)json, n);
+    f.close();
+  } else if(SPIFFS.exists(TARIFF_FILE)) SPIFFS.remove(TARIFF_FILE);
+  tariff.post(t);
+  return nullptr;
+}
+
+void loadTariff(){
+  if(!SPIFFS.exists(TARIFF_FILE)) return;
+  File f = SPIFFS.open(TARIFF_FILE, FILE_READ);
+  if(!f){ hal::logf("Failed to open tariff"); return; }
+  char buf[TARIFF_JSON_MAX];
+  size_t n = f.read((uint8_t*)buf, sizeof(buf));
+  f.close();
+  TariffTable t;
+  const char *err = compileTariff(buf, n, t);
+  if(err){ hal::logf("Tariff ignored: %s", err); return; }
+  tariff.post(t);
+  hal::logf("Tariff: %u season(s)", (unsigned)t.seasons);
+}
@@ -0,0 +1,119 @@
+#include "telemetry.h"
+#include <math.h>
+#include <string.h>
+
+static inline void put16(uint8_t* p, uint16_t v){ p[0]=v; p[1]=v>>8; }
+static inline void put32(uint8_t* p, uint32_t v){ p[0]=v; p[1]=v>>8; p[2]=v>>16; p[3]=v>>24; }
+static inline void put64(uint8_t* p, uint64_t v){ put32(p,(uint32_t)v); put32(p+4,(uint32_t)(v>>32)); }
+
+static inline uint32_t scaled(float x, float k){
+  if(!(x>0)) return 0;
+  float y = x*k;
+  return y>=4294967295.0f ? 0xFFFFFFFFu : (uint32_t)lroundf(y);
+}
+static inline uint16_t milli16(float x){
+  uint32_t v = scaled(x, 1000.0f);
+  return v>0xFFFF ? 0xFFFF : v;
+}
+
+size_t encodeStateFrame(uint8_t* out, size_t cap, uint32_t seq, uint32_t priceMilli,
+                        uint16_t sampleHz, const LoadState* loads, uint8_t n,
+                        const uint16_t* changed){
+  uint8_t count = 0;
+  for(uint8_t k=0;k<n;k++) if(!changed || changed[k]) count++;
+  size_t len = FRAME_HEADER_LEN + (size_t)count*FRAME_LOAD_LEN;
+  if(len > cap) return 0;
+  memset(out, 0, len);
+  out[0]='P'; out[1]='T'; out[2]=FRAME_VERSION; out[3]=count;
+  put32(out+4, seq); put32(out+8, priceMilli); put16(out+12, sampleHz);
+  put16(out+14, changed ? FRAME_DELTA : 0);
+
+  uint8_t* p = out + FRAME_HEADER_LEN;
+  for(uint8_t k=0;k<n;k++){
+    if(changed && !changed[k]) continue;
+    const LoadState& s = loads[k];
+    const WindowStats& w = s.r.w;
+    p[0] = s.id;
+    p[1] = (s.relay ? LOAD_RELAY : 0) | (s.timerEnd ? LOAD_TIMER : 0);
+    put16(p+2, w.n>0xFFFF ? 0xFFFF : w.n);
+    put16(p+4, milli16(w.v.mean)); put16(p+6, milli16(w.v.min)); put16(p+8, milli16(w.v.max));
+    put32(p+12, scaled(w.i.mean,1e6f)); put32(p+16, scaled(w.i.min,1e6f));
+    put32(p+20, scaled(w.i.max,1e6f));  put32(p+24, scaled(w.i.rms,1e6f));
+    put32(p+28, scaled(w.p.mean,1e3f)); put32(p+32, scaled(w.p.min,1e3f)); put32(p+36, scaled(w.p.max,1e3f));
+    put64(p+40, (uint64_t)s.r.uWh); put64(p+48, (uint64_t)s.r.costMilli);
+    put32(p+56, s.r.onSecondsToday); put32(p+60, s.limitSec); put32(p+64, s.timerEnd);
+    put16(p+68, s.timerMin);
+    put32(p+72, s.demandMw); put32(p+76, s.peakMw);
+    p += FRAME_LOAD_LEN;
+  }
+  return len;
+}
+
+// ---------------- Delta / deadband ----------------
+static inline bool moved(float sent, float cur, float rel, float abs){
+  float band = fabsf(sent)*rel;
+  if(band < abs) band = abs;
+  return fabsf(cur - sent) >= band;
+}
+
+void DeltaState::rebase(const LoadState* cur, uint8_t n, uint32_t priceMilli, uint16_t sampleHz){
+  if(n > DELTA_MAX_LOADS) n = DELTA_MAX_LOADS;
+  for(uint8_t k=0;k<n;k++) sent[k] = cur[k];
+  price = priceMilli; hz = sampleHz;
+  valid = true;
+}
+
+bool DeltaState::diff(const LoadState* cur, uint8_t n, uint16_t* changed){
+  if(n > DELTA_MAX_LOADS) n = DELTA_MAX_LOADS;
+  bool any = false;
+  for(uint8_t k=0;k<n;k++){
+    const LoadState& c = cur[k];
+    LoadState& s = sent[k];
+    const WindowStats& cw = c.r.w;
+    const WindowStats& sw = s.r.w;
+    uint16_t m = 0;
+    if(!valid){
+      m = F_ALL;
+    } else {
+      if(moved(sw.v.mean, cw.v.mean, band.rel, band.volt)) m |= F_VOLT;
+      if(moved(sw.i.mean, cw.i.mean, band.rel, band.curr)) m |= F_CURR;
+      if(moved(sw.p.mean, cw.p.mean, band.rel, band.power)) m |= F_POWER;
+      if(moved(sw.p.max, cw.p.max, band.rel, band.power) || moved(sw.p.min, cw.p.min, band.rel, band.power) ||
+         moved(sw.i.rms, cw.i.rms, band.rel, band.curr) || moved(sw.i.max, cw.i.max, band.rel, band.curr) ||
+         moved(sw.v.min, cw.v.min, band.rel, band.volt) || moved(sw.v.max, cw.v.max, band.rel, band.volt)) m |= F_STATS;
+      if(c.r.uWh - s.r.uWh >= band.uWh || c.r.uWh < s.r.uWh) m |= F_ENERGY;
+      if(c.r.costMilli - s.r.costMilli >= band.costMilli || c.r.costMilli < s.r.costMilli) m |= F_COST;
+      if(c.relay != s.relay) m |= F_RELAY;
+      if(c.r.onSecondsToday != s.r.onSecondsToday) m |= F_ONSEC;
+      if(c.limitSec != s.limitSec) m |= F_LIMIT;
+      if(c.timerMin != s.timerMin || c.timerEnd != s.timerEnd) m |= F_TIMER;
+      if(c.demandMw != s.demandMw || c.peakMw != s.peakMw) m |= F_DEMAND;
+    }
+    if(m & F_VOLT) s.r.w.v.mean = cw.v.mean;
+    if(m & F_CURR) s.r.w.i.mean = cw.i.mean;
+    if(m & F_POWER) s.r.w.p.mean = cw.p.mean;
+    if(m & F_STATS){
+      float vm = s.r.w.v.mean, im = s.r.w.i.mean, pm = s.r.w.p.mean;
+      s.r.w = cw;
+      s.r.w.v.mean = vm; s.r.w.i.mean = im; s.r.w.p.mean = pm;
+    }
+    if(m & F_ENERGY) s.r.uWh = c.r.uWh;
+    if(m & F_COST) s.r.costMilli = c.r.costMilli;
+    if(m & F_RELAY) s.relay = c.relay;
+    if(m & F_ONSEC) s.r.onSecondsToday = c.r.onSecondsToday;
+    if(m & F_LIMIT) s.limitSec = c.limitSec;
+    if(m & F_TIMER){ s.timerMin = c.timerMin; s.timerEnd = c.timerEnd; }
+    if(m & F_DEMAND){ s.demandMw = c.demandMw; s.peakMw = c.peakMw; }
+    s.id = c.id;
+    changed[k] = m;
+    if(m) any = true;
+  }
+  valid = true;
+  return any;
+}
+
+bool DeltaState::globalsChanged(uint32_t priceMilli, uint16_t sampleHz){
+  if(priceMilli == price && sampleHz == hz) return false;
+  price = priceMilli; hz = sampleHz;
+  return true;
+}
@@ -0,0 +1,105 @@
+#include "timerwheel.h"
+
+TimerWheel timers;
+
+void TimerWheel::detach(Timer &t){
+  *t.pprev = t.next;
+  if(t.next) t.next->pprev = t.pprev;
+  t.next = nullptr; t.pprev = nullptr;
+}
+
+void TimerWheel::begin(uint32_t nowMs){
+  lastMs = nowMs;
+  carryMs = 0;
+}
+
+// Level by distance: a timer goes to the finest level whose span covers it,
+// in the slot its expiry falls in there. Beyond the top level's span it parks
+// in the top slot furthest out and is re-placed when that slot cascades.
+void TimerWheel::place(Timer &t){
+  uint32_t delta = t.expires-now;
+  uint8_t level = 0;
+  uint32_t at = t.expires;
+  if((int32_t)delta < 0) at = now;
+  else if(delta >= WHEEL_SPAN){ level = WHEEL_LEVELS-1; at = now+WHEEL_SPAN-1; }
+  else while(delta >= (1UL<<(WHEEL_BITS*(level+1)))) level++;
+  Timer *&head = slots[level][(at>>(WHEEL_BITS*level)) & WHEEL_MASK];
+  t.next = head;
+  if(head) head->pprev = &t.next;
+  head = &t;
+  t.pprev = &head;
+}
+
+// Re-places the slot of `level` that the current tick has reached; every
+// timer in it lands at least one level lower.
+void TimerWheel::cascade(uint8_t level){
+  uint32_t idx = (now>>(WHEEL_BITS*level)) & WHEEL_MASK;
+  if(idx==0 && level+1<WHEEL_LEVELS) cascade(level+1);
+  Timer *t = slots[level][idx];
+  slots[level][idx] = nullptr;
+  while(t){
+    Timer *next = t->next;
+    place(*t);
+    cascaded++;
+    t = next;
+  }
+}
+
+void TimerWheel::arm(Timer &t, uint32_t delayMs){
+  if(t.armed()) cancel(t);
+  // Tick `now` runs WHEEL_TICK_MS-carryMs from here, each later one a tick on.
+  uint32_t ms = delayMs+carryMs;
+  t.expires = now + (ms>WHEEL_TICK_MS ? (ms-1)/WHEEL_TICK_MS : 0);
+  place(t);
+  pending++;
+}
+
+void TimerWheel::cancel(Timer &t){
+  if(!t.armed()) return;
+  detach(t);
+  pending--;
+}
+
+uint32_t TimerWheel::remainingMs(const Timer &t) const {
+  if(!t.armed()) return 0;
+  uint32_t ticks = t.expires-now;
+  if((int32_t)ticks < 0) ticks = 0;
+  return ticks*WHEEL_TICK_MS + (WHEEL_TICK_MS-carryMs);
+}
+
+uint32_t TimerWheel::advance(uint32_t nowMs){
+  carryMs += nowMs-lastMs;
+  lastMs = nowMs;
+  if(!pending){
+    // Nothing to visit: jump straight to the current tick.
+    now += carryMs/WHEEL_TICK_MS;
+    carryMs %= WHEEL_TICK_MS;
+    return 0;
+  }
+  uint32_t n = 0;
+  while(carryMs >= WHEEL_TICK_MS){
+    carryMs -= WHEEL_TICK_MS;
+    uint32_t idx = now & WHEEL_MASK;
+    if(idx==0) cascade(1);
+    // Detach the due slot first: callbacks may arm into it again (for the
+    // next round) or cancel a timer that is still waiting on this list.
+    Timer *due = slots[0][idx];
+    slots[0][idx] = nullptr;
+    if(due) due->pprev = &due;
+    now++;
+    while(due){
+      Timer &t = *due;
+      detach(t);
+      pending--;
+      if(t.periodMs){
+        t.expires += (t.periodMs+WHEEL_TICK_MS-1)/WHEEL_TICK_MS;
+        place(t);
+        pending++;
+      }
+      n++;
+      if(t.fn) t.fn(t);
+    }
+  }
+  fired += n;
+  return n;
+}
@@ -0,0 +1,342 @@
+#include "tsdb.h"
+#include "crc.h"
+#include <SPIFFS.h>
+#include <string.h>
+#include <stdio.h>
+
+const TierSpec TIERS[TIER_COUNT] = {
+  {'r', 1,     4, 32*1024, false},
+  {'m', 60,    4, 64*1024, false},
+  {'h', 3600,  4, 32*1024, true},
+  {'d', 86400, 2, 16*1024, true},
+};
+
+// Segment header, first 16 bytes of every segment file.
+struct SegHeader {
+  uint8_t magic[4];  // "TSG1"
+  uint8_t tier;
+  uint8_t rsv[3];
+  uint32_t seq;      // increases by one per new segment in the tier
+  uint32_t t0;       // time of the first record
+};
+static_assert(sizeof(SegHeader)==TS_RECORD_LEN, "header layout");
+static const uint8_t SEG_MAGIC[4] = {'T','S','G','1'};
+
+static void segPath(char* out, Tier tier, uint8_t slot){
+  snprintf(out, 16, "/ts/%c%u", TIERS[tier].prefix, (unsigned)slot);
+}
+
+static bool recordValid(Tier tier, const uint8_t* rec){
+  if(tier==TIER_RAW) return crc16(rec,14) == ((const RawRecord*)rec)->crc;
+  return crc8(rec,15) == ((const RollRecord*)rec)->crc;
+}
+
+void TsStore::begin(int32_t tzOffset){
+  tz = tzOffset;
+  resumed = false;
+  char path[16];
+  for(uint8_t t=0;t<TIER_COUNT;t++){
+    used[t]=0; staged[t]=0; cur[t]=0;
+    uint32_t best=0;
+    for(uint8_t s=0;s<TIERS[t].segments;s++){
+      seg[t][s] = Seg();
+      segPath(path,(Tier)t,s);
+      if(!SPIFFS.exists(path)) continue;
+      File f = SPIFFS.open(path, FILE_READ);
+      if(!f) continue;
+      SegHeader h;
+      if(f.read((uint8_t*)&h,sizeof(h))==sizeof(h) && !memcmp(h.magic,SEG_MAGIC,4) && h.tier==t){
+        seg[t][s].seq=h.seq; seg[t][s].t0=h.t0;
+        if(h.seq>best){
+          best=h.seq; cur[t]=s;
+          size_t size=f.size();
+          // A torn tail would misalign later appends; start a fresh segment instead.
+          used[t] = (size % TS_RECORD_LEN) ? TIERS[t].segBytes : size;
+        }
+      }
+      f.close();
+    }
+  }
+}
+
+uint32_t TsStore::bucketStart(Tier tier, uint32_t t) const {
+  int64_t lt = (int64_t)t + tz;
+  return (uint32_t)(lt - lt % TIERS[tier].bucketSec - tz);
+}
+
+void TsStore::ingest(uint32_t t, const TsSample* s){
+  RawRecord r;
+  memset(&r,0,sizeof(r));
+  r.t=t;
+  for(uint8_t l=0;l<TS_LOADS;l++){
+    r.p[l]=tsPower(s[l].pMean);
+    if(s[l].relay) r.relays |= 1<<l;
+  }
+  r.crc=crc16((const uint8_t*)&r,14);
+  if(!resumed) resume(t);
+  stage(TIER_RAW,(const uint8_t*)&r);
+
+  for(uint8_t tier=TIER_MIN;tier<TIER_COUNT;tier++){
+    uint32_t b = bucketStart((Tier)tier,t);
+    bool closed=false;
+    for(uint8_t l=0;l<TS_LOADS;l++){
+      Roll &a = roll[tier][l];
+      if(a.open && a.t0!=b){ closeBucket((Tier)tier,l); closed=true; }
+      if(!a.open){ a=Roll(); a.t0=b; a.open=true; }
+      a.uWh += s[l].uWh;
+      a.onSec += s[l].onSec;
+      uint16_t pk=tsPower(s[l].pMax);
+      if(pk>a.pMax) a.pMax=pk;
+    }
+    if(closed && TIERS[tier].eager) flushTier((Tier)tier);
+  }
+}
+
+// Sums finer-tier records into the open buckets of one tier.
+struct ResumeCtx { uint64_t uWh[TS_LOADS]; uint32_t onSec[TS_LOADS]; uint16_t pMax[TS_LOADS]; };
+
+static bool resumeVisit(Tier tier, const uint8_t* rec, void* ctx){
+  ResumeCtx &c = *(ResumeCtx*)ctx;
+  if(tier==TIER_RAW){
+    const RawRecord* r = (const RawRecord*)rec;
+    for(uint8_t l=0;l<TS_LOADS;l++){
+      c.uWh[l] += (uint32_t)r->p[l]*25/9;
+      if(r->relays & (1<<l)) c.onSec[l]++;
+      if(r->p[l]>c.pMax[l]) c.pMax[l]=r->p[l];
+    }
+  } else {
+    const RollRecord* r = (const RollRecord*)rec;
+    if(r->load>=TS_LOADS) return true;
+    c.uWh[r->load] += r->uWh;
+    c.onSec[r->load] += r->onSec;
+    if(r->pMax>c.pMax[r->load]) c.pMax[r->load]=r->pMax;
+  }
+  return true;
+}
+
+// Newest record time in tier, staged or on flash; 0 if none.
+uint32_t TsStore::newest(Tier tier) const {
+  uint32_t t=0;
+  if(staged[tier]){ memcpy(&t, page[tier]+(staged[tier]-1)*TS_RECORD_LEN, 4); return t; }
+  if(!seg[tier][cur[tier]].seq) return 0;
+  char path[16];
+  segPath(path,tier,cur[tier]);
+  File f = SPIFFS.open(path, FILE_READ);
+  if(!f) return 0;
+  uint8_t rec[TS_RECORD_LEN];
+  size_t end = f.size()/TS_RECORD_LEN*TS_RECORD_LEN;
+  // Step back over a torn tail, at most a page.
+  for(uint8_t k=0;k<TS_PAGE_RECORDS && end>sizeof(SegHeader);k++){
+    end -= TS_RECORD_LEN;
+    f.seek(end);
+    if(f.read(rec,TS_RECORD_LEN)==TS_RECORD_LEN && recordValid(tier,rec)){ memcpy(&t,rec,4); break; }
+  }
+  f.close();
+  return t;
+}
+
+// Refills the open buckets of tier from the next finer tier over [from, to).
+void TsStore::rebuild(Tier tier, uint32_t from, uint32_t to){
+  ResumeCtx c;
+  memset(&c,0,sizeof(c));
+  scan((Tier)(tier-1),from,to,resumeVisit,&c);
+  for(uint8_t l=0;l<TS_LOADS;l++){
+    Roll &a = roll[tier][l];
+    a = Roll(); a.t0=from; a.open=true;
+    a.uWh=c.uWh[l]; a.onSec=c.onSec[l]; a.pMax=c.pMax[l];
+  }
+}
+
+// Finest tier first, so each rebuild sees the finer tier's. A bucket left
+// open when the store last ran is closed and written first; the bucket
+// holding t is reopened with what reached flash since it started.
+void TsStore::resume(uint32_t t){
+  resumed = true;
+  for(uint8_t tier=TIER_MIN;tier<TIER_COUNT;tier++){
+    uint32_t b = bucketStart((Tier)tier,t);
+    uint32_t tf = newest((Tier)(tier-1)), last = newest((Tier)tier);
+    uint32_t bf = bucketStart((Tier)tier,tf);
+    if(tf && bf<b && (!last || bf>last)){
+      rebuild((Tier)tier,bf,bf+TIERS[tier].bucketSec);
+      for(uint8_t l=0;l<TS_LOADS;l++) closeBucket((Tier)tier,l);
+      if(TIERS[tier].eager) flushTier((Tier)tier);
+    }
+    rebuild((Tier)tier,b,t);
+  }
+}
+
+static RollRecord makeRoll(uint32_t t0, uint64_t uWh, uint32_t onSec, uint16_t pMax, uint8_t load){
+  RollRecord rec;
+  rec.t=t0;
+  rec.uWh = uWh>0xFFFFFFFFULL ? 0xFFFFFFFFu : (uint32_t)uWh;
+  rec.onSec=onSec; rec.pMax=pMax; rec.load=load;
+  rec.crc=crc8((const uint8_t*)&rec,15);
+  return rec;
+}
+
+void TsStore::closeBucket(Tier tier, uint8_t load){
+  Roll &a = roll[tier][load];
+  RollRecord rec = makeRoll(a.t0,a.uWh,a.onSec,a.pMax,load);
+  stage(tier,(const uint8_t*)&rec);
+  a.open=false;
+}
+
+void TsStore::stage(Tier tier, const uint8_t* rec){
+  memcpy(page[tier]+staged[tier]*TS_RECORD_LEN, rec, TS_RECORD_LEN);
+  if(++staged[tier]==TS_PAGE_RECORDS) flushTier(tier);
+}
+
+void TsStore::flushTier(Tier tier){
+  if(!staged[tier]) return;
+  const TierSpec &spec = TIERS[tier];
+  size_t len = staged[tier]*TS_RECORD_LEN;
+  char path[16];
+  File f;
+
+  if(used[tier]==0 || used[tier]+len > spec.segBytes){
+    // Recycle the next slot; "w" truncates whatever it held.
+    bool first = used[tier]==0 && seg[tier][cur[tier]].seq==0;
+    uint8_t slot = first ? cur[tier] : (cur[tier]+1) % spec.segments;
+    SegHeader h;
+    memcpy(h.magic,SEG_MAGIC,4); h.tier=tier; memset(h.rsv,0,3);
+    h.seq = seg[tier][cur[tier]].seq + 1;
+    memcpy(&h.t0, page[tier], 4);
+    segPath(path,tier,slot);
+    f = SPIFFS.open(path, FILE_WRITE);
+    if(!f || f.write((const uint8_t*)&h,sizeof(h))!=sizeof(h)){
+      if(f) f.close();
+      recordsDropped += staged[tier]; staged[tier]=0;
+      return;
+    }
+    seg[tier][slot].seq=h.seq; seg[tier][slot].t0=h.t0;
+    cur[tier]=slot; used[tier]=sizeof(h);
+  } else {
+    segPath(path,tier,cur[tier]);
+    f = SPIFFS.open(path, FILE_APPEND);
+  }
+
+  if(f && f.write(page[tier],len)==len){ used[tier]+=len; pageWrites++; }
+  else recordsDropped += staged[tier];
+  if(f) f.close();
+  staged[tier]=0;
+}
+
+void TsStore::flush(){
+  for(uint8_t t=0;t<TIER_COUNT;t++) flushTier((Tier)t);
+}
+
+Tier TsStore::pickTier(uint32_t from, uint32_t step) const {
+  int t=TIER_COUNT-1;
+  while(t>TIER_RAW && TIERS[t].bucketSec>step) t--;
+  // Step up while this tier starts after from and the next one starts earlier.
+  for(;t<TIER_DAY;t++){
+    uint32_t o=oldest((Tier)t), up=oldest((Tier)(t+1));
+    if(o && o<=from) break;
+    if(!up || (o && up>=o)) break;
+  }
+  return (Tier)t;
+}
+
+uint32_t TsStore::oldest(Tier tier) const {
+  uint32_t seq=0, t0=0;
+  for(uint8_t s=0;s<TIERS[tier].segments;s++)
+    if(seg[tier][s].seq && (!seq || seg[tier][s].seq<seq)){ seq=seg[tier][s].seq; t0=seg[tier][s].t0; }
+  if(!seq && staged[tier]) memcpy(&t0, page[tier], 4);
+  return t0;
+}
+
+size_t TsStore::scan(Tier tier, uint32_t from, uint32_t to, TsVisitor fn, void* ctx){
+  const TierSpec &spec = TIERS[tier];
+  uint8_t order[4], n=0;
+  for(uint8_t s=0;s<spec.segments;s++){
+    if(!seg[tier][s].seq) continue;
+    uint8_t k=n++;
+    while(k>0 && seg[tier][order[k-1]].seq > seg[tier][s].seq){ order[k]=order[k-1]; k--; }
+    order[k]=s;
+  }
+
+  size_t visited=0;
+  uint8_t buf[TS_PAGE_RECORDS*TS_RECORD_LEN];
+  char path[16];
+  for(uint8_t k=0;k<n;k++){
+    const Seg &sg = seg[tier][order[k]];
+    if(sg.t0 >= to) return visited;
+    if(k+1<n && seg[tier][order[k+1]].t0+spec.bucketSec <= from) continue;  // wholly before from
+    segPath(path,tier,order[k]);
+    File f = SPIFFS.open(path, FILE_READ);
+    if(!f) continue;
+    f.seek(sizeof(SegHeader));
+    size_t got;
+    while((got = f.read(buf,sizeof(buf))) >= TS_RECORD_LEN){
+      for(size_t o=0;o+TS_RECORD_LEN<=got;o+=TS_RECORD_LEN){
+        const uint8_t* rec = buf+o;
+        if(!recordValid(tier,rec)) continue;
+        uint32_t t; memcpy(&t,rec,4);
+        if(t>=to){ f.close(); return visited; }
+        if(t+spec.bucketSec<=from) continue;
+        visited++;
+        if(!fn(tier,rec,ctx)){ f.close(); return visited; }
+      }
+    }
+    f.close();
+  }
+
+  for(uint8_t i=0;i<staged[tier];i++){
+    const uint8_t* rec = page[tier]+i*TS_RECORD_LEN;
+    uint32_t t; memcpy(&t,rec,4);
+    if(t>=to) return visited;
+    if(t+spec.bucketSec<=from) continue;
+    visited++;
+    if(!fn(tier,rec,ctx)) return visited;
+  }
+
+  // The bucket still being filled, so coarse tiers reach up to now.
+  if(tier==TIER_RAW) return visited;
+  for(uint8_t l=0;l<TS_LOADS;l++){
+    const Roll &a = roll[tier][l];
+    if(!a.open || a.t0+spec.bucketSec<=from || a.t0>=to) continue;
+    RollRecord rec = makeRoll(a.t0,a.uWh,a.onSec,a.pMax,l);
+    visited++;
+    if(!fn(tier,(const uint8_t*)&rec,ctx)) return visited;
+  }
+  return visited;
+}
+
+// ---------------- Range aggregation ----------------
+void TsBucketer::begin(uint32_t f, uint32_t st, Emit e, void* c){
+  from=f; step=st?st:1; emit=e; ctx=c; open=false; emitted=0;
+}
+
+void TsBucketer::add(Tier tier, const uint8_t* rec){
+  uint32_t t; memcpy(&t,rec,4);
+  uint32_t b = t<from ? from : from + (t-from)/step*step;
+  if(open && b!=cur.t) finish();
+  if(!open){ memset(&cur,0,sizeof(cur)); cur.t=b; open=true; }
+
+  if(tier==TIER_RAW){
+    const RawRecord* r = (const RawRecord*)rec;
+    for(uint8_t l=0;l<TS_LOADS;l++){
+      cur.uWh[l] += (uint32_t)r->p[l]*25/9;   // 10 mW for 1 s, in uWh
+      if(r->relays & (1<<l)) cur.onSec[l]++;
+      if(r->p[l]>cur.pMax[l]) cur.pMax[l]=r->p[l];
+    }
+  } else {
+    const RollRecord* r = (const RollRecord*)rec;
+    if(r->load>=TS_LOADS) return;
+    cur.uWh[r->load] += r->uWh;
+    cur.onSec[r->load] += r->onSec;
+    if(r->pMax>cur.pMax[r->load]) cur.pMax[r->load]=r->pMax;
+  }
+}
+
+void TsBucketer::finish(){
+  if(!open) return;
+  open=false;
+  emitted++;
+  emit(cur,ctx);
+}
+
+bool TsBucketer::visit(Tier tier, const uint8_t* rec, void* ctx){
+  ((TsBucketer*)ctx)->add(tier,rec);
+  return true;
+}
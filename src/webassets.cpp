@@ -0,0 +1,87 @@
+#include "webassets.h"
+#include <SPIFFS.h>
+#include <string.h>
+
+AssetIndex assets;
+
+const char* const CONTENT_TYPES[] = {
+  "text/plain", "text/html", "application/javascript", "text/css",
+  "application/json", "image/x-icon", "image/svg+xml",
+};
+static const char* const EXTENSIONS[] = { "", ".html", ".js", ".css", ".json", ".ico", ".svg" };
+
+uint8_t contentTypeOf(const char* path){
+  const char* dot = strrchr(path, '.');
+  if(!dot) return 0;
+  for(uint8_t k=1;k<sizeof(EXTENSIONS)/sizeof(EXTENSIONS[0]);k++) if(!strcmp(dot, EXTENSIONS[k])) return k;
+  return 0;
+}
+
+static uint32_t fnv1a(const char* s){
+  uint32_t h = 2166136261u;
+  while(*s){ h ^= (uint8_t)*s++; h *= 16777619u; }
+  return h;
+}
+
+uint8_t AssetIndex::begin(const char* manifest){
+  memset(slots, 0, sizeof(slots));
+  count = 0;
+  File m = SPIFFS.open(manifest, "r");
+  if(!m) return 0;
+  char line[ASSET_PATH_LEN+ETAG_LEN+8];
+  size_t n = 0;
+  for(;;){
+    int c = m.read();
+    if(c>=0 && c!='\n'){ if(n<sizeof(line)-1) line[n++]=(char)c; continue; }
+    line[n] = 0;
+    n = 0;
+    char* sp = strchr(line, ' ');
+    if(sp && count<ASSET_MAX && (size_t)(sp-line)<ASSET_PATH_LEN && strlen(sp+1)==ETAG_LEN){
+      size_t len = sp-line;
+      *sp = 0;
+      char fsPath[ASSET_PATH_LEN+3];
+      memcpy(fsPath, line, len); memcpy(fsPath+len, ".gz", 4);
+      bool gz = true;
+      File f = SPIFFS.open(fsPath, "r");
+      if(!f){ gz = false; f = SPIFFS.open(line, "r"); }
+      if(f){
+        uint32_t h = fnv1a(line);
+        Asset* a = &slots[h & (ASSET_SLOTS-1)];
+        while(a->path[0] && strcmp(a->path, line)) a = &slots[(++h) & (ASSET_SLOTS-1)];
+        if(!a->path[0]) count++;
+        strcpy(a->path, line);
+        memcpy(a->etag, sp+1, ETAG_LEN+1);
+        a->size = f.size();
+        a->type = contentTypeOf(line);
+        a->gz = gz;
+        f.close();
+      }
+    }
+    if(c<0) break;
+  }
+  m.close();
+  return count;
+}
+
+const Asset* AssetIndex::find(const char* path) const {
+  uint32_t h = fnv1a(path);
+  for(uint8_t k=0;k<ASSET_SLOTS;k++){
+    const Asset &a = slots[(h+k) & (ASSET_SLOTS-1)];
+    if(!a.path[0]) return nullptr;
+    if(!strcmp(a.path, path)) return &a;
+  }
+  return nullptr;
+}
+
+bool etagMatches(const char* inm, const char* etag){
+  if(!inm || !*inm) return false;
+  if(!strcmp(inm, "*")) return true;
+  // A list of quoted tags, possibly weak (W/"..."): match on the quoted body.
+  size_t n = strlen(etag);
+  for(const char* p = strchr(inm,'"'); p; p = strchr(p+1,'"')){
+    if(!strncmp(p+1, etag, n) && p[n+1]=='"') return true;
+    p = strchr(p+1,'"');   // skip to this tag's closing quote
+    if(!p) break;
+  }
+  return false;
+}
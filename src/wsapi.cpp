@@ -0,0 +1,302 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <math.h>
+#include <string.h>
+#include "wsapi.h"
+#include "hal.h"
+#include "sampler.h"
+#include "control.h"
+#include "settings.h"
+#include "demand.h"
+
+uint32_t wsClients = 0;
+uint32_t wsBinClients = 0;
+uint32_t wsDeltaClients = 0;
+uint32_t wsNeedKey = 0;
+uint32_t stateSeq = 0;
+DeltaState deltas;
+uint16_t ticksSinceKey = 0;
+
+NotifLog notifLog;
+WsTxStats wsTx = {0,0,0};
+
+// JSON state frames are built and serialized into these every tick rather
+// than into a fresh heap document and String, so the heap next to lwIP and
+// the WebSockets buffers does not fragment over weeks of uptime.
+static StaticJsonDocument<STATE_JSON_CAPACITY> stateDoc;
+static char stateOut[STATE_OUT_MAX];
+
+// ---------------- Notifications ----------------
+void pushNotification(const char* s){
+  hal::logf("NOTIF: %s", s);
+  uint32_t ts = hal::epoch();
+  uint32_t seq = notifLog.append(ts, s);
+  StaticJsonDocument<JSON_OBJECT_SIZE(4)> out;
+  out["type"] = "notification"; out["seq"] = seq; out["ts"] = ts; out["text"] = s;
+  char buf[256];
+  size_t n = serializeJson(out, buf, sizeof(buf));
+  wsBroadcastText(buf, n);
+}
+
+// ---------------- WebSocket ----------------
+void wsConnected(uint8_t num){
+  uint32_t bit = 1UL<<num;
+  wsClients |= bit; wsNeedKey |= bit;
+}
+
+void wsDisconnected(uint8_t num){
+  uint32_t bit = ~(1UL<<num);
+  wsClients &= bit; wsBinClients &= bit; wsDeltaClients &= bit; wsNeedKey &= bit;
+}
+
+static void cmdRelay(uint8_t, const JsonDocument &doc){
+  int id = doc["id"] | 1; bool state = doc["state"] | false;
+  if(id>=1 && id<=4) relayCommand(id-1, state, hal::epoch());
+}
+
+static void cmdSetTimer(uint8_t, const JsonDocument &doc){
+  int id=doc["id"]|1; int m=doc["minutes"]|0;
+  if(id>=1 && id<=4){ 
+    setTimer(id-1, m, hal::epoch());
+    markSettingsDirty();
+  }
+}
+
+static void cmdSetLimit(uint8_t, const JsonDocument &doc){
+  int id=doc["id"]|1; unsigned long s=doc["seconds"]|0;
+  if(id>=1 && id<=4 && s>0){ setLimit(id-1, s); markSettingsDirty(); }
+}
+
+static void cmdSetLimits(uint8_t, const JsonDocument &doc){
+  JsonArrayConst arr=doc["seconds"];
+  for(int i=0;i<4 && i<(int)arr.size();i++){
+    unsigned long s=arr[i]|0UL;
+    if(s>0) setLimit(i, s);
+  }
+  markSettingsDirty();
+}
+
+static void cmdDelayOn(uint8_t, const JsonDocument &doc){
+  int id=doc["id"]|1; int m=doc["minutes"]|0;
+  if(id>=1 && id<=4) delayOn(id-1, m);
+}
+
+// onAt / offAt: seconds into the local day, -1 or absent = none.
+static void cmdSchedule(uint8_t, const JsonDocument &doc){
+  int id=doc["id"]|1;
+  if(id>=1 && id<=4){
+    setSchedule(id-1, doc["onAt"]|-1L, doc["offAt"]|-1L);
+    markSettingsDirty();
+  }
+}
+
+// minutes: demand window (15 or 30); watts: panel demand limit, 0 = none.
+static void cmdSetDemand(uint8_t, const JsonDocument &doc){
+  if(doc.containsKey("minutes")) demandWindowMin = clampDemandWindow(doc["minutes"]|15);
+  if(doc.containsKey("watts")) demandLimitW = doc["watts"]|0UL;
+  markSettingsDirty();
+}
+
+// priority: shedding order at the demand limit, highest first; 0 = never.
+static void cmdSetShed(uint8_t, const JsonDocument &doc){
+  int id=doc["id"]|1; int p=doc["priority"]|0;
+  if(id>=1 && id<=4 && p>=0 && p<=255){ L[id-1].shed=p; markSettingsDirty(); }
+}
+
+// price: flat unit price per kWh; out of range or not a number is ignored.
+static void cmdSetPrice(uint8_t, const JsonDocument &doc){
+  double p=doc["price"]|8.0;
+  if(!validPrice(p)) return;
+  priceMilli=lround(p*1000.0);
+  markSettingsDirty();
+}
+
+static void cmdSetSampleRate(uint8_t, const JsonDocument &doc){
+  int hz=doc["hz"]|(int)SAMPLE_HZ_DEFAULT;
+  sampleHz=clampSampleHz(hz);
+  markSettingsDirty();
+}
+
+static void cmdBinary(uint8_t num, const JsonDocument &doc){
+  uint32_t bit = 1UL<<num;
+  if(doc["on"]|false) wsBinClients |= bit;
+  else wsBinClients &= ~bit;
+  wsNeedKey |= bit;
+}
+
+static void cmdDelta(uint8_t num, const JsonDocument &doc){
+  uint32_t bit = 1UL<<num;
+  if(doc["on"]|false) wsDeltaClients |= bit;
+  else wsDeltaClients &= ~bit;
+  wsNeedKey |= bit;
+}
+
+static void cmdClearNotifs(uint8_t, const JsonDocument &){
+  notifLog.clear();
+  pushNotification("Notifs cleared");
+}
+
+struct WsCmd {
+  const char* name;
+  void (*run)(uint8_t num, const JsonDocument &doc);
+};
+
+// Sorted by name (strcmp order): wsCommand binary-searches it.
+static const WsCmd WS_CMDS[] = {
+  {"binary",        cmdBinary},
+  {"clearNotifs",   cmdClearNotifs},
+  {"delayOn",       cmdDelayOn},
+  {"delta",         cmdDelta},
+  {"relay",         cmdRelay},
+  {"schedule",      cmdSchedule},
+  {"setDemand",     cmdSetDemand},
+  {"setLimit",      cmdSetLimit},
+  {"setLimits",     cmdSetLimits},
+  {"setPrice",      cmdSetPrice},
+  {"setSampleRate", cmdSetSampleRate},
+  {"setShed",       cmdSetShed},
+  {"setTimer",      cmdSetTimer},
+};
+static const size_t WS_CMD_COUNT = sizeof(WS_CMDS)/sizeof(WS_CMDS[0]);
+
+static const WsCmd* findCmd(const char* name){
+  size_t lo=0, hi=WS_CMD_COUNT;
+  while(lo<hi){
+    size_t mid=(lo+hi)/2;
+    int c=strcmp(name, WS_CMDS[mid].name);
+    if(c==0) return &WS_CMDS[mid];
+    if(c<0) hi=mid; else lo=mid+1;
+  }
+  return nullptr;
+}
+
+// Only the fields some command reads; anything else in a message is skipped
+// by the parser without being stored.
+static const JsonDocument& cmdFilter(){
+  static StaticJsonDocument<JSON_OBJECT_SIZE(12)> f;
+  if(f.isNull()){
+    f["cmd"]=true; f["id"]=true; f["state"]=true; f["minutes"]=true;
+    f["seconds"]=true; f["price"]=true; f["hz"]=true; f["on"]=true;
+    f["onAt"]=true; f["offAt"]=true; f["watts"]=true; f["priority"]=true;
+  }
+  return f;
+}
+
+// payload is parsed in place (zero-copy: strings in the document point into
+// it), so a command allocates nothing. It must stay valid and writable until
+// this returns, which the WebSockets library's receive buffer is.
+void wsCommand(uint8_t num, char* payload, size_t length){
+  StaticJsonDocument<JSON_OBJECT_SIZE(8)+JSON_ARRAY_SIZE(8)> doc;
+  DeserializationError err = deserializeJson(doc, payload, length, DeserializationOption::Filter(cmdFilter()));
+  if(err){ hal::logf("WS JSON parse error: %s", err.c_str()); return; }
+  const char* name = doc["cmd"];
+  if(!name) return;
+  const WsCmd* cmd = findCmd(name);
+  if(cmd) cmd->run(num, doc);
+}
+
+// ---------------- Broadcast ----------------
+void collectState(LoadState* out){
+  Readings s = readings.read();
+  for(int i=0;i<4;i++){
+    out[i].id=i+1; out[i].r=s.r[i]; out[i].relay=L[i].relay;
+    out[i].limitSec=L[i].usageLimitSeconds; out[i].timerMin=L[i].timerMinutes; out[i].timerEnd=L[i].timerEndEpoch;
+    out[i].demandMw=demand.demandMw[i]; out[i].peakMw=demand.today[i].mW;
+  }
+}
+
+void fillLoadJson(JsonObject o, const LoadState &s, uint16_t f){
+  const Reading &r=s.r;
+  o["id"]=s.id;
+  if(f&F_VOLT) o["voltage"]=r.w.v.mean;
+  if(f&F_CURR) o["current"]=r.w.i.mean;
+  if(f&F_POWER) o["power"]=r.w.p.mean;
+  if(f&F_ENERGY) o["energy"]=r.uWh/1e6;
+  if(f&F_STATS){
+    o["vMin"]=r.w.v.min; o["vMax"]=r.w.v.max; o["iMin"]=r.w.i.min; o["iMax"]=r.w.i.max; o["iRms"]=r.w.i.rms;
+    o["pMin"]=r.w.p.min; o["pMax"]=r.w.p.max; o["n"]=r.w.n;
+  }
+  if(f&F_RELAY) o["relay"]=s.relay;
+  if(f&F_ONSEC) o["onSecToday"]=r.onSecondsToday;
+  if(f&F_LIMIT) o["limitSec"]=s.limitSec;
+  if(f&F_TIMER){
+    o["timerMin"]=s.timerMin;
+    if(s.timerEnd>0 || f!=F_ALL) o["timerEnd"]=s.timerEnd;
+  }
+  if(f&F_COST) o["cost"]=r.costMilli/1000.0;
+  if(f&F_DEMAND){ o["demand"]=s.demandMw/1000.0; o["peakToday"]=s.peakMw/1000.0; }
+}
+
+// The panel total's demand and peaks (binary clients get the loads' only).
+static void fillPanelJson(JsonObject o){
+  const DemandPeak &d=demand.today[DEMAND_TOTAL], &m=demand.month[DEMAND_TOTAL];
+  o["demand"]=demand.demandMw[DEMAND_TOTAL]/1000.0;
+  o["peakToday"]=d.mW/1000.0; o["peakTodayAt"]=d.at;
+  o["peakMonth"]=m.mW/1000.0; o["peakMonthAt"]=m.at;
+  o["window"]=demand.windowMin(); o["limit"]=demandLimitW;
+}
+
+void sendToClients(uint32_t mask, const char* out, size_t n){
+  if(mask==wsClients) { wsBroadcastText(out, n); return; }
+  for(uint8_t c=0;c<32;c++) if(mask & (1UL<<c)) wsSendText(c, out, n);
+}
+
+// Sends ls to the binary and text clients in the masks. With changed set,
+// only the loads / fields flagged there go out (a delta update).
+void sendState(uint32_t binMask, uint32_t txtMask, const LoadState* ls, const uint16_t* changed, bool globals){
+  if(binMask){
+    uint8_t frame[FRAME_HEADER_LEN+4*FRAME_LOAD_LEN];
+    size_t n = encodeStateFrame(frame, sizeof(frame), stateSeq, priceMilli, sampleHz, ls, 4, changed);
+    for(uint8_t c=0;c<32;c++) if(binMask & (1UL<<c)) wsSendBin(c, frame, n);
+  }
+  if(!txtMask) return;
+
+  JsonDocument &doc = stateDoc;
+  doc.clear();
+  doc["type"]="state"; doc["seq"]=stateSeq;
+  if(changed) doc["delta"]=true;
+  if(globals){ doc["unitPrice"]=priceMilli/1000.0; doc["sampleHz"]=sampleHz; }
+  JsonArray arr = doc.createNestedArray("loads");
+  bool panel = !changed;
+  for(int i=0;i<4;i++){
+    uint16_t f = changed ? changed[i] : (uint16_t)F_ALL;
+    if(f) fillLoadJson(arr.createNestedObject(), ls[i], f);
+    if(f & F_DEMAND) panel = true;
+  }
+  if(panel) fillPanelJson(doc.createNestedObject("panel"));
+  if(doc.memoryUsage() > wsTx.maxArena) wsTx.maxArena = doc.memoryUsage();
+  size_t n = serializeJson(doc, stateOut, sizeof(stateOut));
+  // A cut-off frame is not valid JSON; drop it rather than confuse clients.
+  if(doc.overflowed() || n+1 >= sizeof(stateOut)){ wsTx.truncated++; return; }
+  if(n > wsTx.maxPayload) wsTx.maxPayload = n;
+  sendToClients(txtMask, stateOut, n);
+}
+
+void broadcastState(){
+  LoadState ls[4];
+  collectState(ls);
+  stateSeq++;
+
+  // Full state to non-delta clients, changed-only to the rest. Deltas are
+  // diffed against one shared baseline, so a keyframe goes to every client
+  // and rebases it: every KEYFRAME_TICKS, and as soon as a delta client is
+  // owed one (on connect or resync) rather than leaving it to drift from a
+  // baseline it never got.
+  bool key = ++ticksSinceKey >= KEYFRAME_TICKS || (wsNeedKey & wsDeltaClients & wsClients);
+  uint32_t full = (wsClients & ~wsDeltaClients) | (key ? wsClients : 0);
+  uint32_t delta = wsClients & ~full;
+  wsNeedKey = 0;
+
+  uint16_t changed[4];
+  bool any = false, globals = false;
+  if(key){
+    ticksSinceKey = 0;
+    deltas.rebase(ls, 4, priceMilli, sampleHz);
+  } else if(delta){
+    any = deltas.diff(ls, 4, changed);
+    globals = deltas.globalsChanged(priceMilli, sampleHz);
+  }
+
+  sendState(full & wsBinClients, full & ~wsBinClients, ls, nullptr, true);
+  if(delta && (any || globals)) sendState(delta & wsBinClients, delta & ~wsBinClients, ls, changed, globals);
+}
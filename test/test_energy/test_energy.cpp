@@ -0,0 +1,81 @@
+// Integer energy / cost path against a long-double reference over a
+// simulated year: pio test -e native -f test_energy
+#include <unity.h>
+#include <stdio.h>
+#include <math.h>
+#include "meter.h"
+
+const uint32_t YEAR_SEC = 365u*86400u;
+const uint32_t PRICES[] = {4500, 8000, 12500};   // milli-currency per kWh
+
+void pushNotification(const char*){}
+
+// Deterministic, so a failure reproduces.
+static uint32_t rng = 12345;
+static uint32_t rnd(uint32_t n){ rng = rng*1664525u+1013904223u; return (rng>>8)%n; }
+
+void setUp(){ rng = 12345; }
+void tearDown(){}
+
+// EnergyAcc carries its remainders, so the integer uWh must equal the floor
+// of the exact integral (summed in 128 bits), and the cost, with the price
+// changing hourly, may only trail the exact one by the carried fraction.
+void test_energy_acc_exact_over_a_year(){
+  const uint32_t HZ = 2;
+  EnergyAcc acc;
+  unsigned __int128 twiceNj = 0;                   // 2*mW*us, exact
+  long double refCost = 0;
+  uint32_t p0 = 500000, price = PRICES[0];
+  for(uint32_t s=0;s<YEAR_SEC*HZ;s++){
+    uint32_t dt = 1000000/HZ - 3000 + rnd(6001);   // scheduling jitter
+    uint32_t p1 = p0;
+    int32_t step = (int32_t)rnd(20001)-10000;        // random walk, 0..3 kW
+    if(step<0 && (uint32_t)-step>p1) p1 = 0; else p1 += step;
+    if(p1>3000000) p1 = 3000000;
+    if(s%(3600*HZ)==0){ price = PRICES[rnd(3)]; }
+    twiceNj += (uint64_t)(p0+p1)*dt;
+    refCost += (long double)(p0+p1)*dt/7.2e6L*price/1e9L;
+    acc.add(p0, p1, dt, price);
+    p0 = p1;
+  }
+  char msg[96];
+  TEST_ASSERT_EQUAL_INT64((int64_t)(twiceNj/7200000u), acc.uWh);
+  long double lag = refCost-acc.costMilli;
+  snprintf(msg,sizeof(msg),"cost %lld vs %.3Lf",(long long)acc.costMilli,refCost);
+  TEST_ASSERT_TRUE_MESSAGE(lag > -1e-3L && lag < 1.001L, msg);
+}
+
+// Channel rounds each power reading to a whole mW; over a year of readings
+// that must stay well under a ppm of the float-exact integral.
+void test_channel_drift_over_a_year(){
+  const uint32_t HZ = 1;
+  Channel ch;
+  long double refUWh = 0;
+  uint32_t tUs = 0;
+  float v = 230.0f, i = 0.0f, lastP = 0;
+  for(uint32_t s=0;s<YEAR_SEC*HZ;s++){
+    uint32_t dt = 1000000/HZ - 20000 + rnd(40001);
+    tUs += dt;
+    v = 225.0f + rnd(1000)*0.01f;
+    i = rnd(100000)*0.0001f;                        // 0..10 A
+    float p = v*i;
+    if(s) refUWh += ((long double)lastP+p)*dt/7.2e3L;
+    lastP = p;
+    ch.add(tUs, v, i, 8000);
+    if(s%HZ==0) ch.closeWindow();
+  }
+  long double ppm = (ch.energy.uWh-refUWh)/refUWh*1e6L;
+  char msg[96];
+  snprintf(msg,sizeof(msg),"uWh %lld vs %.1Lf (%+.4Lf ppm)",(long long)ch.energy.uWh,refUWh,ppm);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE_MESSAGE(fabsl(ppm) < 0.1L, msg);
+  // Cost at a flat price is the energy's, to the milli-currency.
+  TEST_ASSERT_EQUAL_INT64(ch.energy.uWh*8000/1000000000, ch.energy.costMilli);
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_energy_acc_exact_over_a_year);
+  RUN_TEST(test_channel_drift_over_a_year);
+  return UNITY_END();
+}
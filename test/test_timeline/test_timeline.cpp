@@ -0,0 +1,124 @@
+// Relay control on the simulated board, checked against the expected
+// timeline: pio test -e native -f test_timeline
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "../../src/sim/sim.h"
+#include "sampler.h"
+#include "control.h"
+
+const uint32_t RUN_SEC = 43300;
+const uint32_t SCHEDULE_OFF_SEC = 43200;   // of the run
+const size_t MAX_EVENTS = 16;
+
+struct Event { uint64_t us; char text[48]; };
+static Event events[MAX_EVENTS];
+static size_t numEvents = 0;
+
+void pushNotification(const char* text){
+  if(numEvents==MAX_EVENTS) return;
+  Event &e = events[numEvents++];
+  e.us = sim::nowUs();
+  snprintf(e.text, sizeof(e.text), "%s", text);
+}
+
+void setUp(){}
+void tearDown(){}
+
+// The sim_main scenario plus a daily schedule on load 1, run once.
+static void runScenario(){
+  static bool ran = false;
+  if(ran) return;
+  ran = true;
+  sim::setLogging(false);
+  sim::setEpoch(sim::DEFAULT_EPOCH);
+  sim::setLoad(0, 12.0f, 0.50f, 0.02f);  // switched OFF by its schedule
+  sim::setLoad(1, 12.0f, 1.25f, 0.05f);  // 1 h usage limit
+  sim::setLoad(2, 5.0f, 2.00f, 0.10f);   // 30 min timer
+  hal::initRelays();
+  controlBegin();
+  sampler.tzOffset = sim::TZ_OFFSET;
+  sampler.begin();
+
+  setLimit(0, 0);        // the default 12 h limit would land on the schedule
+  setLimit(1, 3600);
+  setTimer(2, 30, hal::epoch());
+  setSchedule(0, -1, (sim::DEFAULT_EPOCH+sim::TZ_OFFSET+SCHEDULE_OFF_SEC)%86400);
+  relayCommand(0, true, hal::epoch());
+  relayCommand(1, true, hal::epoch());
+  relayCommand(2, true, hal::epoch());
+
+  uint32_t lastSec = hal::epoch();
+  while(sim::nowUs() < (uint64_t)RUN_SEC*1000000){
+    sim::advance(1000000/sampleHz);
+    sampler.sample();
+    timers.advance(hal::millis());
+    uint32_t t = hal::epoch();
+    if(t==lastSec) continue;
+    lastSec = t;
+    controlTick(t);
+  }
+}
+
+// Time of the one event named text, in s of the run; fails if not exactly one.
+static double eventAt(const char* text){
+  double at = -1;
+  int seen = 0;
+  for(size_t k=0;k<numEvents;k++)
+    if(!strcmp(events[k].text, text)){ at = events[k].us/1e6; seen++; }
+  char msg[80];
+  snprintf(msg, sizeof(msg), "\"%s\" seen %d times", text, seen);
+  TEST_ASSERT_TRUE_MESSAGE(seen==1, msg);
+  return at;
+}
+
+// Fires at its mark, or within a wheel tick and a sample of it.
+static void assertAt(const char* text, uint32_t sec){
+  double at = eventAt(text);
+  char msg[80];
+  snprintf(msg, sizeof(msg), "\"%s\" at %.3f s, expected %lu s", text, at, (unsigned long)sec);
+  TEST_ASSERT_TRUE_MESSAGE(at >= sec && at < sec+0.2, msg);
+}
+
+void test_relays_on_at_start(){
+  runScenario();
+  assertAt("Relay 1 ON", 0);
+  assertAt("Relay 2 ON", 0);
+  assertAt("Relay 3 ON", 0);
+}
+
+void test_timer_off_at_1800s(){
+  runScenario();
+  assertAt("Relay 3 auto OFF by timer", 1800);
+  TEST_ASSERT_FALSE(sim::relay(2));
+}
+
+void test_limit_off_at_3600s(){
+  runScenario();
+  assertAt("Relay 2 auto OFF by limit", 3600);
+  TEST_ASSERT_FALSE(sim::relay(1));
+  TEST_ASSERT_UINT32_WITHIN(1, 3600, readings.read().r[1].onSecondsToday);
+}
+
+void test_schedule_off_at_43200s(){
+  runScenario();
+  assertAt("Relay 1 auto OFF by schedule", SCHEDULE_OFF_SEC);
+  TEST_ASSERT_FALSE(sim::relay(0));
+}
+
+void test_nothing_else_happened(){
+  runScenario();
+  TEST_ASSERT_EQUAL(6, numEvents);
+  TEST_ASSERT_EQUAL(0, sim::relaySwitches(3));
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_relays_on_at_start);
+  RUN_TEST(test_timer_off_at_1800s);
+  RUN_TEST(test_limit_off_at_3600s);
+  RUN_TEST(test_schedule_off_at_43200s);
+  RUN_TEST(test_nothing_else_happened);
+  return UNITY_END();
+}